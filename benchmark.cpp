@@ -0,0 +1,561 @@
+/*
+    Created By: Thomas Osgood
+
+    Description:
+        Benchmark for btree<int> and job_tree, and for the
+        same keys in compact_btree (32-bit index links), with
+        std::set and std::map as the baseline.
+
+        Every run builds a tree from N distinct keys, then
+        searches, reads the min/max and deletes everything.
+        Keys come in one of four orders:
+            sorted  - 0, 1, 2, ...
+            reverse - N-1, N-2, ...
+            uniform - random shuffle / random lookups
+            zipf    - random shuffle for inserts and deletes,
+                      Zipf (theta 0.99) skewed lookups
+        Each row reports throughput, latency percentiles
+        (from a sample of up to 100K timed calls), the tree
+        height and the peak RSS of that run.
+
+    Usage:
+    ./<binary_name> [max_elements] [min_elements]
+        sizes go 1K, 10K, ... up to max_elements (default 1M).
+        pass 100000000 for the 100M runs (needs ~10GB RAM).
+
+    To Compile:
+    g++ -std=c++17 -O2 -o <binary_name> benchmark.cpp
+*/
+
+// ------- REQUIRED Includes -------
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "btree.h"
+#include "compact_btree.h"
+#include "job_tree.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+enum key_order { SORTED, REVERSE, UNIFORM, ZIPF };
+const char *order_names[] = {"sorted", "reverse", "uniform", "zipf"};
+
+/*
+    Define Op Result
+
+    One measured operation: how many calls, how long they
+    all took, and the latency of every sampled call.
+*/
+struct op_result {
+    std::string op;
+    size_t calls;
+    double seconds;
+    std::vector<uint64_t> samples;
+};
+
+/*
+    Define Zipf Generator
+
+    Zipf distributed ranks in [0, n) using the method from
+    Gray et al., "Quickly Generating Billion-Record Synthetic
+    Databases". Only zeta(n) is computed up front, so there
+    is no n sized table even for 100M keys.
+*/
+class zipf_generator {
+public:
+    zipf_generator(uint64_t n, double theta = 0.99);
+    uint64_t next(std::mt19937_64& rng);
+
+private:
+    double alpha;
+    double eta;
+    uint64_t n;
+    double theta;
+    double zetan;
+};
+
+/*
+    Function Prototypes
+*/
+void bench_btree(key_order order, size_t n);
+void bench_compact_btree(key_order order, size_t n);
+void bench_compact_jobs(key_order order, size_t n);
+void bench_job_tree(key_order order, size_t n);
+void bench_std_map(key_order order, size_t n);
+void bench_std_set(key_order order, size_t n);
+std::vector<int> insert_keys(key_order order, size_t n);
+std::vector<int> lookup_keys(key_order order, size_t n);
+bool parse_size(const char *text, size_t& value);
+double peak_rss_mb();
+void print_header();
+void print_result(const char *name, key_order order, size_t n, const op_result& result, int height, double rss);
+void reset_peak_rss();
+template <class Op>
+op_result time_op(const char *op, size_t calls, Op fn);
+
+// keeps the optimizer from dropping search results
+volatile uint64_t sink = 0;
+
+/*
+    Main Function
+*/
+int main(int argc, char **argv) {
+    size_t max_n = 1000000;
+    size_t min_n = 1000;
+    if (((argc > 1) && !parse_size(argv[1], max_n)) || ((argc > 2) && !parse_size(argv[2], min_n)) || (min_n < 1)) {
+        std::cout << "Usage: " << argv[0] << " [max_elements] [min_elements >= 1]" << std::endl;
+        return 1;
+    }
+
+    print_header();
+    for (size_t n = min_n; n <= max_n; n *= 10) {
+        for (int o = SORTED; o <= ZIPF; o++) {
+            key_order order = (key_order)o;
+            bench_btree(order, n);
+            bench_compact_btree(order, n);
+            bench_std_set(order, n);
+            bench_job_tree(order, n);
+            bench_compact_jobs(order, n);
+            bench_std_map(order, n);
+        }
+        if (n > max_n / 10) break; // the next size is past max_n (or would wrap)
+    }
+    return 0;
+}
+
+/*
+    Sub Functions
+*/
+
+/*
+Function Name: zipf_generator
+Description:
+    Sets up the generator for ranks in [0, n).
+Input(s):
+    n - uint64_t. number of distinct ranks.
+    theta - double. skew. 0.99 puts ~60% of draws in the
+            hottest 1% of keys for n = 1M.
+Return(s):
+    None
+*/
+zipf_generator::zipf_generator(uint64_t n, double theta) : n(n), theta(theta) {
+    zetan = 0;
+    for (uint64_t i = 1; i <= n; i++) zetan += 1.0 / std::pow((double)i, theta);
+    double zeta2 = 1.0 + 1.0 / std::pow(2.0, theta);
+    alpha = 1.0 / (1.0 - theta);
+    eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+}
+
+/*
+Function Name: next
+Description:
+    Draws one rank. Rank 0 is the most popular.
+Input(s):
+    rng - random engine reference.
+Return(s):
+    rank - uint64_t. value in [0, n).
+*/
+uint64_t zipf_generator::next(std::mt19937_64& rng) {
+    double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+    double uz = u * zetan;
+    if (uz < 1.0) return 0;
+    if (uz < 1.0 + std::pow(0.5, theta)) return 1;
+    uint64_t rank = (uint64_t)(n * std::pow(eta * u - eta + 1.0, alpha));
+    return (rank < n) ? rank : n - 1;
+}
+
+/*
+Function Name: time_op
+Description:
+    Runs fn(0) .. fn(calls - 1) and times the whole loop.
+    Every stride-th call is also timed on its own so the
+    percentiles cost almost nothing on the other calls.
+Input(s):
+    op - char pointer. name of the operation.
+    calls - size_t. number of calls to make.
+    fn - callable taking the call index.
+Return(s):
+    result - op_result. timings for the operation.
+*/
+template <class Op>
+op_result time_op(const char *op, size_t calls, Op fn) {
+    op_result result;
+    result.op = op;
+    result.calls = calls;
+    size_t stride = std::max<size_t>(1, calls / 100000);
+    result.samples.reserve(calls / stride + 1);
+
+    bench_clock::time_point start = bench_clock::now();
+    for (size_t i = 0; i < calls; i++) {
+        if (i % stride == 0) {
+            bench_clock::time_point t0 = bench_clock::now();
+            fn(i);
+            bench_clock::time_point t1 = bench_clock::now();
+            result.samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        } else fn(i);
+    }
+    result.seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    return result;
+}
+
+/*
+Function Name: insert_keys
+Description:
+    Builds the insert (and delete) order for a run. The keys
+    are always 0 .. n-1, only their order changes.
+Input(s):
+    order - key_order. sorted, reverse, uniform or zipf.
+    n - size_t. number of keys.
+Return(s):
+    keys - vector of ints.
+*/
+std::vector<int> insert_keys(key_order order, size_t n) {
+    std::vector<int> keys(n);
+    for (size_t i = 0; i < n; i++) keys[i] = (int)i;
+    if (order == REVERSE) std::reverse(keys.begin(), keys.end());
+    if ((order == UNIFORM) || (order == ZIPF)) {
+        std::mt19937_64 rng(n);
+        std::shuffle(keys.begin(), keys.end(), rng);
+    }
+    return keys;
+}
+
+/*
+Function Name: lookup_keys
+Description:
+    Builds the search order for a run. Zipf ranks are
+    scattered over the key space by multiplying with a
+    large prime, so the hot keys are not all neighbours.
+Input(s):
+    order - key_order. sorted, reverse, uniform or zipf.
+    n - size_t. number of keys.
+Return(s):
+    keys - vector of ints.
+*/
+std::vector<int> lookup_keys(key_order order, size_t n) {
+    if ((order == SORTED) || (order == REVERSE)) return insert_keys(order, n);
+
+    std::vector<int> keys(n);
+    std::mt19937_64 rng(n + 1);
+    if (order == UNIFORM) {
+        for (size_t i = 0; i < n; i++) keys[i] = (int)(rng() % n);
+    } else {
+        zipf_generator zipf(n);
+        for (size_t i = 0; i < n; i++) keys[i] = (int)((zipf.next(rng) * 2654435761ULL) % n);
+    }
+    return keys;
+}
+
+/*
+Function Name: parse_size
+Description:
+    Reads a whole decimal argument, digits only.
+Input(s):
+    text - char pointer. argument text.
+    value - size_t reference. receives the number.
+Return(s):
+    true - the argument is a number that fits a size_t.
+    false - empty, not all digits, or too large.
+*/
+bool parse_size(const char *text, size_t& value) {
+    if ((unsigned char)(*text - '0') >= 10) return false;
+    char *rest = NULL;
+    errno = 0;
+    unsigned long long parsed = std::strtoull(text, &rest, 10);
+    if ((*rest != '\0') || (errno == ERANGE) || (parsed > SIZE_MAX)) return false;
+    value = (size_t)parsed;
+    return true;
+}
+
+/*
+Function Name: reset_peak_rss
+Description:
+    Resets the kernel's peak RSS mark (Linux 4.0+) so each
+    run reports its own peak. Elsewhere the peak only grows.
+Input(s):
+    None
+Return(s):
+    None
+*/
+void reset_peak_rss() {
+    FILE *f = std::fopen("/proc/self/clear_refs", "w");
+    if (f == NULL) return;
+    std::fputs("5", f);
+    std::fclose(f);
+}
+
+/*
+Function Name: peak_rss_mb
+Description:
+    Reads the peak RSS of the process, from VmHWM when
+    /proc is there, else from getrusage().
+Input(s):
+    None
+Return(s):
+    rss - double. peak resident set size in MB.
+*/
+double peak_rss_mb() {
+    FILE *f = std::fopen("/proc/self/status", "r");
+    if (f != NULL) {
+        char line[256];
+        while (std::fgets(line, sizeof(line), f) != NULL) {
+            if (std::strncmp(line, "VmHWM:", 6) == 0) {
+                std::fclose(f);
+                return std::atof(line + 6) / 1024.0;
+            }
+        }
+        std::fclose(f);
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+}
+
+/*
+Function Name: print_header
+Description:
+    Prints the column names of the result table.
+Input(s):
+    None
+Return(s):
+    None
+*/
+void print_header() {
+    std::printf("%-14s %-8s %10s %-14s %10s %8s %8s %8s %9s %7s %9s\n",
+        "structure", "keys", "n", "op", "Mops/s", "p50 ns", "p99 ns", "p99.9 ns", "max ns", "height", "peak MB");
+}
+
+/*
+Function Name: print_result
+Description:
+    Prints one row of the result table.
+Input(s):
+    name - char pointer. structure under test.
+    order - key_order. key order of the run.
+    n - size_t. number of keys.
+    result - op_result reference. timings to print.
+    height - int. tree height, or -1 when not known.
+    rss - double. peak RSS of the run in MB.
+Return(s):
+    None
+*/
+void print_result(const char *name, key_order order, size_t n, const op_result& result, int height, double rss) {
+    std::vector<uint64_t> s(result.samples);
+    std::sort(s.begin(), s.end());
+    uint64_t p50 = s.empty() ? 0 : s[s.size() / 2];
+    uint64_t p99 = s.empty() ? 0 : s[(s.size() * 99) / 100];
+    uint64_t p999 = s.empty() ? 0 : s[(s.size() * 999) / 1000];
+    uint64_t pmax = s.empty() ? 0 : s.back();
+    double mops = (result.seconds > 0) ? result.calls / result.seconds / 1e6 : 0;
+
+    std::printf("%-14s %-8s %10zu %-14s %10.2f %8llu %8llu %8llu %9llu ",
+        name, order_names[order], n, result.op.c_str(), mops,
+        (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)p999, (unsigned long long)pmax);
+    if (height >= 0) std::printf("%7d", height);
+    else std::printf("%7s", "-");
+    std::printf(" %9.1f\n", rss);
+    std::fflush(stdout);
+}
+
+/*
+Function Name: bench_btree
+Description:
+    btree<int>: insert, search, minKey/maxKey and erase.
+Input(s):
+    order - key_order. key order of the run.
+    n - size_t. number of keys.
+Return(s):
+    None
+*/
+void bench_btree(key_order order, size_t n) {
+    std::vector<int> keys = insert_keys(order, n);
+    std::vector<int> lookups = lookup_keys(order, n);
+    std::vector<op_result> results;
+    reset_peak_rss();
+
+    btree<int> tree;
+    results.push_back(time_op("insert", n, [&](size_t i) { tree.insert(keys[i]); }));
+    int height = tree.height();
+    results.push_back(time_op("search", n, [&](size_t i) { sink += (tree.search(lookups[i]) != NULL); }));
+    results.push_back(time_op("minKey/maxKey", n, [&](size_t i) { sink += (i & 1) ? tree.maxKey() : tree.minKey(); }));
+    results.push_back(time_op("erase", n, [&](size_t i) { tree.erase(keys[i]); }));
+
+    double rss = peak_rss_mb();
+    for (size_t i = 0; i < results.size(); i++) print_result("btree<int>", order, n, results[i], height, rss);
+}
+
+/*
+Function Name: bench_std_set
+Description:
+    std::set<int> baseline for bench_btree.
+Input(s):
+    order - key_order. key order of the run.
+    n - size_t. number of keys.
+Return(s):
+    None
+*/
+void bench_std_set(key_order order, size_t n) {
+    std::vector<int> keys = insert_keys(order, n);
+    std::vector<int> lookups = lookup_keys(order, n);
+    std::vector<op_result> results;
+    reset_peak_rss();
+
+    std::set<int> tree;
+    results.push_back(time_op("insert", n, [&](size_t i) { tree.insert(keys[i]); }));
+    results.push_back(time_op("search", n, [&](size_t i) { sink += (tree.find(lookups[i]) != tree.end()); }));
+    results.push_back(time_op("minKey/maxKey", n, [&](size_t i) { sink += (i & 1) ? *tree.rbegin() : *tree.begin(); }));
+    results.push_back(time_op("erase", n, [&](size_t i) { tree.erase(keys[i]); }));
+
+    double rss = peak_rss_mb();
+    for (size_t i = 0; i < results.size(); i++) print_result("std::set", order, n, results[i], -1, rss);
+}
+
+/*
+Function Name: bench_compact_btree
+Description:
+    compact_btree<int>: the bench_btree run on index linked
+    nodes.
+Input(s):
+    order - key_order. key order of the run.
+    n - size_t. number of keys.
+Return(s):
+    None
+*/
+void bench_compact_btree(key_order order, size_t n) {
+    std::vector<int> keys = insert_keys(order, n);
+    std::vector<int> lookups = lookup_keys(order, n);
+    std::vector<op_result> results;
+    reset_peak_rss();
+
+    compact_btree<int> tree;
+    results.push_back(time_op("insert", n, [&](size_t i) { tree.insert(keys[i]); }));
+    int height = tree.height();
+    results.push_back(time_op("search", n, [&](size_t i) { sink += (tree.search(lookups[i]) != NULL); }));
+    results.push_back(time_op("minKey/maxKey", n, [&](size_t i) { sink += (i & 1) ? tree.maxKey() : tree.minKey(); }));
+    results.push_back(time_op("erase", n, [&](size_t i) { tree.erase(keys[i]); }));
+
+    double rss = peak_rss_mb();
+    for (size_t i = 0; i < results.size(); i++) print_result("compact<int>", order, n, results[i], height, rss);
+}
+
+/*
+Function Name: bench_job_tree
+Description:
+    job_tree: new_job, search_job, search_oldest/newest and
+    delete_job. Key k is job (k / 1000) - (k % 1000).
+Input(s):
+    order - key_order. key order of the run.
+    n - size_t. number of keys.
+Return(s):
+    None
+*/
+void bench_job_tree(key_order order, size_t n) {
+    std::vector<int> keys = insert_keys(order, n);
+    std::vector<int> lookups = lookup_keys(order, n);
+    std::vector<op_result> results;
+    reset_peak_rss();
+
+    job_tree jobs;
+    results.push_back(time_op("new_job", n, [&](size_t i) {
+        jobs.new_job(keys[i] / 1000, keys[i] % 1000, 1.0f, 2.0f);
+    }));
+    int height = jobs.height();
+    results.push_back(time_op("search_job", n, [&](size_t i) {
+        sink += (jobs.search_job(lookups[i] / 1000, lookups[i] % 1000) != NULL);
+    }));
+    results.push_back(time_op("oldest/newest", n, [&](size_t i) {
+        sink += ((i & 1) ? jobs.search_newest() : jobs.search_oldest())->key.job_number();
+    }));
+    results.push_back(time_op("delete_job", n, [&](size_t i) { jobs.delete_job(keys[i] / 1000, keys[i] % 1000); }));
+
+    double rss = peak_rss_mb();
+    for (size_t i = 0; i < results.size(); i++) print_result("job_tree", order, n, results[i], height, rss);
+}
+
+/*
+Function Name: bench_std_map
+Description:
+    std::map<job_key, job_data> baseline for bench_job_tree.
+Input(s):
+    order - key_order. key order of the run.
+    n - size_t. number of keys.
+Return(s):
+    None
+*/
+void bench_std_map(key_order order, size_t n) {
+    std::vector<int> keys = insert_keys(order, n);
+    std::vector<int> lookups = lookup_keys(order, n);
+    std::vector<op_result> results;
+    reset_peak_rss();
+
+    std::map<job_key, job_data, job_key_less> jobs;
+    results.push_back(time_op("new_job", n, [&](size_t i) {
+        job_key key = {(unsigned int)keys[i] / 1000, (unsigned int)keys[i] % 1000};
+        job_data data = {1.0f, 2.0f};
+        jobs.insert(std::make_pair(key, data));
+    }));
+    results.push_back(time_op("search_job", n, [&](size_t i) {
+        job_key key = {(unsigned int)lookups[i] / 1000, (unsigned int)lookups[i] % 1000};
+        sink += (jobs.find(key) != jobs.end());
+    }));
+    results.push_back(time_op("oldest/newest", n, [&](size_t i) {
+        sink += ((i & 1) ? jobs.rbegin()->first : jobs.begin()->first).job_number();
+    }));
+    results.push_back(time_op("delete_job", n, [&](size_t i) {
+        job_key key = {(unsigned int)keys[i] / 1000, (unsigned int)keys[i] % 1000};
+        jobs.erase(key);
+    }));
+
+    double rss = peak_rss_mb();
+    for (size_t i = 0; i < results.size(); i++) print_result("std::map", order, n, results[i], -1, rss);
+}
+
+/*
+Function Name: bench_compact_jobs
+Description:
+    compact_btree<job_key, job_data>: the bench_job_tree run
+    on index linked nodes, with cost and estimate kept apart
+    from the keys.
+Input(s):
+    order - key_order. key order of the run.
+    n - size_t. number of keys.
+Return(s):
+    None
+*/
+void bench_compact_jobs(key_order order, size_t n) {
+    std::vector<int> keys = insert_keys(order, n);
+    std::vector<int> lookups = lookup_keys(order, n);
+    std::vector<op_result> results;
+    reset_peak_rss();
+
+    compact_btree<job_key, job_data, job_key_less> jobs;
+    results.push_back(time_op("new_job", n, [&](size_t i) {
+        job_data data = {1.0f, 2.0f};
+        jobs.insert(job_key(keys[i] / 1000, keys[i] % 1000), data);
+    }));
+    int height = jobs.height();
+    results.push_back(time_op("search_job", n, [&](size_t i) {
+        sink += (jobs.search(job_key(lookups[i] / 1000, lookups[i] % 1000)) != NULL);
+    }));
+    results.push_back(time_op("oldest/newest", n, [&](size_t i) {
+        sink += ((i & 1) ? jobs.maxKey() : jobs.minKey()).job_number();
+    }));
+    results.push_back(time_op("delete_job", n, [&](size_t i) { jobs.erase(job_key(keys[i] / 1000, keys[i] % 1000)); }));
+
+    double rss = peak_rss_mb();
+    for (size_t i = 0; i < results.size(); i++) print_result("compact_jobs", order, n, results[i], height, rss);
+}
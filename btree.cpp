@@ -2,384 +2,31 @@
     Created By: Thomas Osgood
     
     Description:
-        Simple binary tree program.
-        
-    To-Do:
-        1) Put Class in separate file and create custom header. 
-            i)  btree.h
-        2) Add sort/balance function.
+        Simple binary tree program. The tree itself lives
+        in btree.h.
         
     To Compile:
-    g++ -o <binary_name> btree.cpp
+    g++ -std=c++17 -o <binary_name> btree.cpp
 */
 
 // ------- REQUIRED Includes -------
 #include <iostream>
-#include <limits>
 
-/*
-    Create Structure For Node Object
-*/
-struct node {
-    int key_val;
-    node *left;
-    node *right;
-};
+#include "btree.h"
+#include "btree_multiset.h"
 
 /*
     Function Prototypes
 */
 void printChar(char c = '-', int n = 40);
 
-/*
-    Define Binary Tree Class
-*/
-class btree {
-    public:
-        btree(); // binary tree initializer
-        ~btree(); // binary tree destroyer
-        
-        void destroy_tree();
-        void display_tree();
-        void display_tree_rev();
-        void insert(int key);
-        int maxKey();
-        int minKey();
-        node *search(int key);
-        
-    private:
-        void destroy_tree(node *leaf);
-        void display_tree(node *leaf);
-        void display_tree_rev(node *leaf);
-        void insert(int key, node *leaf);
-        int maxKey(node *leaf);
-        int minKey(node *leaf);
-        node *search(int key, node *leaf);
-        
-        node *root;
-};
-
-/*
-    Class Functions
-*/
-
-// --------- BEGIN Class Functions --------------
-
-/*
-Function Name: btree
-Description:
-    Binary tree function that will be called when the tree
-    is allocated/created.
-Input(s):
-    None
-Return(s):
-    None
-*/
-btree::btree() {
-    std::cout << "[+] Initializing BTREE" << std::endl;
-    root = NULL;
-}
-
-/*
-Function Name: ~btree
-Description:
-    Binary tree function that will be called when the tree
-    is deallocated/destroyed.
-Input(s):
-    None
-Return(s):
-    None
-*/
-btree::~btree() {
-    std::cout << "[-] Destroying BTREE" << std::endl;
-    destroy_tree();
-}
-
-// --------- PRIVATE Class Functions --------------
-
-/*
-Function Name: destroy_tree
-Description:
-    Private function called when the tree is going to be
-    destroyed.  Will recursively go through each node and
-    subnode and delete the entire tree.
-Input(s):
-    leaf - node pointer. current leaf/node to delete.
-Return(s):
-    None
-*/
-void btree::destroy_tree(node *leaf) {
-    if (leaf != NULL) {
-        destroy_tree(leaf->left);
-        destroy_tree(leaf->right);
-        delete leaf;
-    }
-}
-
-/*
-Function Name: display_tree
-Description:
-    Private function designed to display the binary tree.
-    
-    Displays the tree in a left to right (low to high)
-    order, checking for left nodes first, then displaying
-    the current node, then checking for right nodes.
-Input(s):
-    leaf - node pointer. current leaf/node to display.
-Return(s):
-    None
-*/
-void btree::display_tree(node *leaf) {
-    if (leaf->left != NULL) display_tree(leaf->left);
-    std::cout << leaf->key_val << std::endl;
-    if (leaf->right != NULL) display_tree(leaf->right);
-}
-
-/*
-Function Name: display_tree_rev
-Description:
-    Private function designed to display the binary tree
-    in reverse order.
-    
-    Displays the tree in a right to left (high to low)
-    order, checking for right nodes first, then displaying
-    the current node, then checking for left nodes.
-Input(s):
-    leaf - node pointer. current leaf/node to display.
-Return(s):
-    None
-*/
-void btree::display_tree_rev(node *leaf) {
-    if (leaf->right != NULL) display_tree_rev(leaf->right);
-    std::cout << leaf->key_val << std::endl;
-    if (leaf->left != NULL) display_tree_rev(leaf->left);
-}
-
-/*
-Function Name: insert
-Description:    
-    Private BTREE function to insert key value
-    into binary tree.
-Input(s):
-    key - integer value to insert.
-    leaf - node pointer. reference to current spot in tree.
-Return(s):
-    None
-*/
-void btree::insert(int key, node *leaf) {
-    if (key <= leaf->key_val) {
-        if (leaf->left != NULL)
-            insert(key, leaf->left);
-        else {
-            leaf->left = new node;
-            leaf->left->key_val = key;
-            leaf->left->left = NULL;
-            leaf->left->right = NULL;
-        }
-    } else {
-        if (leaf->right != NULL)
-            insert(key, leaf->right);
-        else {
-            leaf->right = new node;
-            leaf->right->key_val = key;
-            leaf->right->left = NULL;
-            leaf->right->right = NULL;
-        }
-    }
-}
-
-/*
-Function Name: maxKey
-Description:
-    Private BTREE function to find the maximum key
-    value in the binary tree.
-    
-    Keep looking for right child nodes until the right
-    child is NULL. Then return the current node's
-    key value.
-Input(s):
-    leaf - node pointer. current btree node.
-Return(s):
-    max - integer. maximum key value in tree.
-*/
-int btree::maxKey(node *leaf) {
-    if (leaf->right != NULL) return maxKey(leaf->right);
-    else return leaf->key_val;
-}
-
-/*
-Function Name: minKey
-Description:
-    Private BTREE function to find the minimum key
-    value in the binary tree.
-    
-    Keep looking for left child nodes until the left
-    child is NULL. Then return the current node's
-    key value.
-Input(s):
-    leaf - node pointer. current btree node.
-Return(s):
-    min - integer. minimum key value in tree.
-*/
-int btree::minKey(node *leaf) {
-    if (leaf->left != NULL) return minKey(leaf->left);
-    else return leaf->key_val;
-}
-
-/*
-Function Name: search
-Description:
-    Private BTREE function to search for a key value in the
-    binary tree and return the node with that value.
-Input(s):
-    key - integer. value to look for in tree.
-    leaf - node pointer. current node in search.
-Return(s):
-    leaf - node pointer. leaf with value.
-    NULL - value not found in tree.
-*/
-node *btree::search(int key, node *leaf) {
-    if (leaf != NULL) {
-        if (leaf->key_val == key) return leaf;
-        else if (key < leaf->key_val) return search(key, leaf->left);
-        else return search(key, leaf->right);
-    } else {
-        return NULL;
-    }
-}
-
-// --------- PUBLIC Class Functions --------------
-
-/*
-Function Name: destroy_tree
-Description:
-    Public BTREE function to destroy the binary tree.
-Input(s):
-    None
-Return(s):
-    None
-*/
-void btree::destroy_tree() {
-    destroy_tree(root);
-}
-
-/*
-Function Name: display_tree
-Description:
-    Public function designed to display the binary tree.
-    
-    This part checks if the root node is NULL. If the root
-    is not NULL, it calls the private function display_tree
-    and gives the root node as the leaf, otherwise it prints
-    a message telling the user that the tree is empty.
-Input(s):
-    None
-Return(s):
-    None
-*/
-void btree::display_tree() {
-    if (root != NULL) display_tree(root);
-    else std::cout << "Tree Is Empty. Nothing To Display" << std::endl;
-}
-
-/*
-Function Name: display_tree_rev
-Description:
-    Public function designed to display the binary tree.
-    
-    This part checks if the root node is NULL. If the root
-    is not NULL, it calls the private function display_tree_rev
-    and gives the root node as the leaf, otherwise it prints
-    a message telling the user that the tree is empty.
-Input(s):
-    None
-Return(s):
-    None
-*/
-void btree::display_tree_rev() {
-    if (root != NULL) display_tree_rev(root);
-    else std::cout << "Tree Is Empty. Nothing To Display" << std::endl;
-}
-
-/*
-Function Name: insert
-Description:    
-    Public BTREE function to insert key value
-    into binary tree.
-Input(s):
-    key - integer value to insert.
-Return(s):
-    None
-*/
-void btree::insert(int key) {
-    if (root != NULL) {
-        insert(key,root);
-    } else {
-        root = new node;
-        root->key_val = key;
-        root->left = NULL;
-        root->right = NULL;
-    }
-}
-
-/*
-Function Name: maxKey
-Description:
-    Public BTREE function to find the maximum key
-    value in the binary tree.
-Input(s):
-    None
-Return(s):
-    max - integer. maximum key value in tree.
-*/
-int btree::maxKey() {
-    if (root != NULL) {
-        return maxKey(root);
-    } else {
-        return std::numeric_limits<int>::max();
-    }
-}
-
-/*
-Function Name: minKey
-Description:
-    Public BTREE function to find the minimum key
-    value in the binary tree.
-Input(s):
-    None
-Return(s):
-    min - integer. minimum key value in tree.
-*/
-int btree::minKey() {
-    if (root != NULL) {
-        return minKey(root);
-    } else {
-        return std::numeric_limits<int>::min();
-    }
-}
-
-/*
-Function Name: search
-Description:
-    Public BTREE function to search for a key value in the
-    binary tree and return the node with that value.
-Input(s):
-    key - integer. value to look for in tree.
-Return(s):
-    leaf - node pointer. leaf with value.
-    NULL - value not found in tree.
-*/
-node *btree::search(int key) {
-    return search(key, root);
-}
-// --------- END Class Functions --------------
-
 /*
     Main Function
 */
 int main(void) {
     // ------ Create New Binary Tree ------
-    btree *my_tree = new btree;
+    std::cout << "[+] Initializing BTREE" << std::endl;
+    btree<int> *my_tree = new btree<int>;
     
     // ------ Populate Binary Tree --------
     my_tree->insert(90);
@@ -391,7 +38,7 @@ int main(void) {
     my_tree->insert(14);
     
     // ------ Search Tree For Value ------
-    node *loc = NULL;
+    btree<int>::node *loc = NULL;
     loc = my_tree->search(23);
     
     printChar();
@@ -399,6 +46,84 @@ int main(void) {
     if (loc != NULL) std::cout << "Value 23 FOUND In Tree!" << std::endl;
     else std::cout << "Value 23 NOT FOUND In Tree" << std::endl;
     
+    // ------ Search Frozen Snapshot For Value ------
+    frozen_btree<int> frozen = my_tree->freeze();
+    
+    if (frozen.search(120) != NULL) std::cout << "Value 120 FOUND In Snapshot!" << std::endl;
+    else std::cout << "Value 120 NOT FOUND In Snapshot" << std::endl;
+    
+    // ------ Bulk Load A Second Tree ------
+    printChar();
+    
+    btree<int> *bulk_tree = new btree<int>;
+    int bulk_keys[] = {10, 14, 14, 20, 23, 90, 100, 120};
+    size_t dups = bulk_tree->build_from(bulk_keys, bulk_keys + 8, true);
+    std::cout << "Bulk loaded " << (8 - dups) << " keys (" << dups << " duplicate dropped)" << std::endl;
+    delete bulk_tree;
+    
+    // ------ Rank & Order Statistics ------
+    printChar();
+    
+    std::cout << "Keys below 23: " << my_tree->rank(23) << std::endl;
+    std::cout << "Median key: " << my_tree->select(my_tree->size() / 2)->key << std::endl;
+    std::cout << "Keys from 10 to 90: " << my_tree->count_range(10, 90) << std::endl;
+
+    // ------ Split, Join & Destroy ------
+    printChar();
+
+    btree<int> lower_tree;
+    for (int i = 1; i <= 20; i++) lower_tree.insert(i);
+    btree<int> *upper_tree = new btree<int>;
+    btree<int> *joined_tree = new btree<int>;
+    lower_tree.split(11, *upper_tree);
+    joined_tree->join(*upper_tree);
+    std::cout << "Split 1..20 at 11, joined the upper half elsewhere: " << joined_tree->size() << " keys" << std::endl;
+    delete upper_tree;
+    delete joined_tree;
+    for (int i = 100; i < 110; i++) lower_tree.insert(i);
+    std::cout << "Lower half after both are destroyed: " << lower_tree.size() << " keys, " << lower_tree.minKey();
+    std::cout << " to " << lower_tree.maxKey() << std::endl;
+
+    // ------ Split, Set Operations & Destroy ------
+    printChar();
+
+    btree<int> evens_tree;
+    for (int i = 0; i <= 40; i += 2) evens_tree.insert_unique(i);
+    const char *op_names[] = {"merge", "intersect", "difference"};
+    for (int op = 0; op < 3; op++) {
+        btree<int> *high_tree = new btree<int>;
+        btree<int> *triples_tree = new btree<int>;
+        for (int i = 0; i <= 60; i += 3) triples_tree->insert_unique(i);
+        evens_tree.split(30, *high_tree);
+        if (op == 0) triples_tree->merge(*high_tree);
+        else if (op == 1) triples_tree->intersect(*high_tree);
+        else triples_tree->difference(*high_tree);
+        std::cout << "Multiples of 3 " << op_names[op] << " evens from 30: " << triples_tree->size() << " keys" << std::endl;
+        delete high_tree;
+        delete triples_tree;
+        for (int i = 30; i <= 40; i += 2) evens_tree.insert_unique(i);
+    }
+    std::cout << "Evens after every split and destroy: " << evens_tree.size() << " keys" << std::endl;
+
+    // ------ Repeated Keys: Node Per Copy vs Counted ------
+    printChar();
+    
+    btree<int> copies_tree;
+    btree_multiset<int> counted_tree;
+    for (int i = 0; i < 100000; i++) {
+        copies_tree.insert(i % 50);
+        counted_tree.insert(i % 50);
+    }
+    std::cout << "100000 readings of 50 values:" << std::endl;
+    std::cout << "  node per copy: " << copies_tree.size() << " nodes, " << copies_tree.memory_usage();
+    std::cout << " bytes, height " << copies_tree.height() << std::endl;
+    std::cout << "  counted:       " << counted_tree.distinct() << " nodes, " << counted_tree.memory_usage();
+    std::cout << " bytes, height " << counted_tree.height() << std::endl;
+    counted_tree.erase_one(7);
+    counted_tree.erase_all(8);
+    std::cout << "  after erasing one 7 and every 8: " << counted_tree.size() << " readings, ";
+    std::cout << counted_tree.occurrences(7) << " sevens, " << counted_tree.count_range(0, 9) << " from 0 to 9" << std::endl;
+    
     // ------ Print Min & Max Tree Values ------
     printChar();
     
@@ -415,6 +140,7 @@ int main(void) {
 
     // ------ Delete BTREE & Exit ------    
     printChar();
+    std::cout << "[-] Destroying BTREE" << std::endl;
     delete my_tree;
     
     return 0;
@@ -0,0 +1,2976 @@
+/*
+    Created By: Thomas Osgood
+
+    Description:
+        Generic binary search tree shared by btree.cpp and
+        job_sorter.cpp.
+
+        btree<Key, Value, Compare, Allocator> stores a Key and
+        a mapped Value per node, orders keys with Compare and
+        gets its nodes from Allocator (node_pool by default).
+
+        parallel_for_each() and parallel_reduce() cut the
+        tree by rank into pieces of consecutive keys and run
+        them on an optional thread_pool. The cut depends only
+        on the tree size, so a reduction gives the same result
+        (float sums included) with any number of threads.
+
+    To Use:
+    #include "btree.h"
+*/
+#ifndef BTREE_H
+#define BTREE_H
+
+// ------- REQUIRED Includes -------
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "thread_pool.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+    Create Structure For Empty Mapped Value
+
+    Used as the Value of trees that only store keys.
+*/
+struct btree_empty {};
+
+/*
+    Define Subtree Summary Trait
+
+    Every node keeps a summary of its whole subtree, kept
+    current by update_node() alongside height and size, so
+    it stays right through insert, erase, rotations and bulk
+    builds. A key/value pair that wants one specializes this
+    trait (see job_tree.h) with:
+        type  - the summary. value initialized it is empty.
+        of    - summary of a single key and value.
+        merge - folds one summary into another.
+    btree::aggregate() then sums a key range in O(log n).
+    The default summary is btree_empty and costs nothing.
+
+    Values must not be changed in place through a node
+    pointer once linked, or the summaries above go stale.
+*/
+template <class Key, class Value>
+struct btree_summary {
+    typedef btree_empty type;
+    static type of(const Key&, const Value&) { return type(); }
+    static void merge(type&, const type&) {}
+};
+
+/*
+    Create Structure For Node Object
+*/
+template <class Key, class Value>
+struct btree_node {
+    typedef btree_summary<Key, Value> summary_traits;
+
+    btree_node(const Key& k, const Value& v) : key(k), value(v), height(1), summary(summary_traits::of(k, v)), size(1), left(NULL), right(NULL), parent(NULL) {}
+
+    Key key;
+    Value value;
+    int height;
+    typename summary_traits::type summary; // of this subtree
+    size_t size; // nodes in this subtree
+    btree_node *left;
+    btree_node *right;
+    btree_node *parent;
+};
+
+/*
+    Define Tree Iterator Class
+
+    Bidirectional in-order iterator over the nodes of a
+    btree. Dereferencing gives the node itself, so the key
+    and value are read in place without copying. Stepping
+    follows child and parent links, so a full walk visits
+    every link at most twice and never recurses.
+*/
+template <class Node>
+class btree_iterator {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef Node value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef Node *pointer;
+        typedef Node &reference;
+
+        btree_iterator() : leaf(NULL), root(NULL) {}
+        btree_iterator(Node *current, Node *const *tree_root) : leaf(current), root(tree_root) {}
+
+        reference operator*() const { return *leaf; }
+        pointer operator->() const { return leaf; }
+        btree_iterator& operator++();
+        btree_iterator operator++(int);
+        btree_iterator& operator--();
+        btree_iterator operator--(int);
+        bool operator==(const btree_iterator& other) const { return leaf == other.leaf; }
+        bool operator!=(const btree_iterator& other) const { return leaf != other.leaf; }
+
+        Node *get() const { return leaf; }
+
+    private:
+        Node *leaf; // NULL at end()
+        Node *const *root; // tree root, to step back from end()
+};
+
+/*
+    Define Fast Compare Trait
+
+    True when comparing two keys is cheap enough that a
+    search should do a single compare per level and test
+    for equality once at the bottom, instead of testing for
+    equality at every node. Arithmetic keys ordered by
+    std::less get this by default; other key types can
+    specialize it.
+*/
+template <class Key, class Compare>
+struct btree_fast_compare : std::integral_constant<bool,
+    std::is_arithmetic<Key>::value &&
+    (std::is_same<Compare, std::less<Key> >::value || std::is_same<Compare, std::less<> >::value)> {};
+
+/*
+    Define Export Formats
+
+    BTREE_EXPORT_TEXT writes one "key value" line per node
+    (just "key" when the tree has no mapped value).
+    BTREE_EXPORT_BINARY writes the raw bytes of the key and
+    value back to back, so every record has the same width.
+*/
+enum btree_export_format { BTREE_EXPORT_TEXT, BTREE_EXPORT_BINARY };
+
+/*
+    Define Text Formatters
+
+    btree_to_chars writes one key or value as text into
+    [first, last) and returns the end of what it wrote, or
+    NULL when it does not fit. Arithmetic types go through
+    std::to_chars; other key and value types add their own
+    overload next to the type (see job_tree.h).
+*/
+template <class T>
+typename std::enable_if<std::is_arithmetic<T>::value, char *>::type
+btree_to_chars(char *first, char *last, const T& value) {
+    std::to_chars_result result = std::to_chars(first, last, value);
+    return (result.ec == std::errc()) ? result.ptr : NULL;
+}
+
+inline char *btree_to_chars(char *first, char *, const btree_empty&) {
+    return first;
+}
+
+/*
+    Define Node Pool Class
+
+    Hands out nodes from large contiguous chunks instead of
+    calling new for every node. Freed nodes are kept on a
+    free list (linked through their own storage) and are
+    handed out again before a new chunk is carved up.
+
+    Two pools can be joined with adopt() so trees can pass
+    nodes to each other (btree::split / btree::join). Joined
+    pools share one set of chunks, which is freed when the
+    last of them goes away; they must not be used from two
+    threads at once. A state that was joined into another
+    forwards to it, so every pool that still held it follows
+    along, not only the one passed to adopt().
+
+    The pool only hands out raw memory. The tree constructs
+    and destroys the nodes in it.
+*/
+template <class T>
+class node_pool {
+    public:
+        template <class U> struct rebind { typedef node_pool<U> other; };
+
+        node_pool(size_t chunk_nodes = 4096); // pool initializer
+        node_pool(const node_pool& other); // copies the settings, not the nodes
+        template <class U> node_pool(const node_pool<U>& other);
+
+        void adopt(node_pool& other);
+        T *allocate();
+        size_t chunk_nodes() const;
+        void deallocate(T *leaf);
+        bool release();
+
+    private:
+        node_pool& operator=(const node_pool&);
+
+        struct pool_state;
+        pool_state& current() const;
+
+        struct free_slot {
+            free_slot *next;
+        };
+
+        /*
+            Create Structure For Pool Memory
+
+            Held by every pool joined through adopt(). Once
+            joined into another state it is left empty and
+            merged points at the state that took its memory.
+        */
+        struct pool_state {
+            pool_state(size_t chunk_nodes) : chunk_size(chunk_nodes), chunk_used(chunk_nodes), free_list(NULL) {}
+            ~pool_state() {
+                for (size_t i = 0; i < chunks.size(); i++) std::allocator<T>().deallocate(chunks[i].first, chunks[i].second);
+            }
+
+            std::vector<std::pair<T *, size_t> > chunks; // (chunk, nodes), current chunk last
+            size_t chunk_size; // nodes per new chunk
+            size_t chunk_used; // nodes handed out of the last chunk
+            free_slot *free_list;
+            std::shared_ptr<pool_state> merged; // state this one was joined into
+        };
+
+        mutable std::shared_ptr<pool_state> state;
+};
+
+/*
+    Define Heap Allocator Class
+
+    Node allocator that calls new/delete for every node,
+    as the trees originally did. Kept for comparison with
+    node_pool.
+*/
+template <class T>
+class heap_allocator {
+    public:
+        template <class U> struct rebind { typedef heap_allocator<U> other; };
+
+        heap_allocator() {}
+        template <class U> heap_allocator(const heap_allocator<U>&) {}
+
+        void adopt(heap_allocator&) {} // nodes are on the heap, nothing to join
+        T *allocate();
+        void deallocate(T *leaf);
+        bool release();
+};
+
+/*
+    Define Frozen Binary Tree Class
+
+    Immutable, pointer-free copy of a btree's keys built by
+    btree::freeze(). Keys are stored as a static B-tree of
+    cache line sized blocks: block k has (per_block + 1)
+    children, found at k * (per_block + 1) + i + 1, so a
+    search touches one cache line per level and compares
+    every key of a block at once.
+*/
+template <class Key, class Compare = std::less<Key> >
+class frozen_btree {
+    public:
+        static const int per_block = (sizeof(Key) < 64) ? int(64 / sizeof(Key)) : 1;
+
+        frozen_btree(); // frozen tree initializer
+
+        void build(const std::vector<Key>& keys);
+        Key maxKey() const;
+        Key minKey() const;
+        const Key *search(const Key& key) const;
+        size_t size() const;
+
+    private:
+        struct alignas(64) key_block {
+            Key keys[per_block];
+        };
+
+        void build(const std::vector<Key>& keys, size_t& pos, size_t block);
+        size_t child(size_t block, int i) const;
+        int rank(const key_block& block, const Key& key) const;
+
+        std::vector<key_block> blocks;
+        Compare comp;
+        size_t count;
+};
+
+/*
+    Define Binary Tree Class
+*/
+template <class Key, class Value = btree_empty, class Compare = std::less<Key>, class Allocator = node_pool<Key> >
+class btree {
+    public:
+        typedef btree_node<Key, Value> node;
+        typedef std::pair<Key, Value> item_type;
+        typedef btree_iterator<node> iterator;
+        typedef std::reverse_iterator<iterator> reverse_iterator;
+        typedef typename node::summary_traits summary_traits;
+        typedef typename summary_traits::type summary_type;
+
+        btree(bool balance = true, const Allocator& allocator = Allocator()); // binary tree initializer
+        ~btree(); // binary tree destroyer
+
+        summary_type aggregate(const Key& lo, const Key& hi) const;
+        iterator begin() const;
+        template <class InputIt>
+        size_t build_from(InputIt first, InputIt last, bool unique = false);
+        void destroy_tree();
+        void difference(btree& other, thread_pool *pool = NULL);
+        void display_tree();
+        void display_tree_rev();
+        size_t count_range(const Key& lo, const Key& hi) const;
+        bool empty() const;
+        iterator end() const;
+        std::pair<iterator, iterator> equal_range(const Key& key) const;
+        bool erase(const Key& key);
+        template <class InputIt>
+        size_t erase_keys(InputIt first, InputIt last);
+        size_t erase_range(const Key& lo, const Key& hi);
+        size_t export_to(iterator& first, char *buffer, size_t capacity, btree_export_format format = BTREE_EXPORT_TEXT) const;
+        bool export_to(int fd, btree_export_format format = BTREE_EXPORT_TEXT) const;
+        frozen_btree<Key, Compare> freeze() const;
+        int height() const;
+        node *insert(const Key& key, const Value& value = Value());
+        std::pair<node *, bool> insert_unique(const Key& key, const Value& value = Value());
+        void intersect(btree& other, thread_pool *pool = NULL);
+        bool join(btree& right);
+        iterator lower_bound(const Key& key) const;
+        Key maxKey() const;
+        node *max_node() const;
+        size_t memory_usage() const;
+        void merge(btree& other, thread_pool *pool = NULL);
+        Key minKey() const;
+        node *min_node() const;
+        template <class Visit>
+        void parallel_for_each(Visit visit, thread_pool *pool = NULL) const;
+        template <class T, class Accumulate, class Combine>
+        T parallel_reduce(T init, Accumulate add, Combine combine, thread_pool *pool = NULL) const;
+        size_t rank(const Key& key) const;
+        reverse_iterator rbegin() const;
+        void reclaim();
+        reverse_iterator rend() const;
+        node *search(const Key& key) const;
+        node *select(size_t i) const;
+        size_t size() const;
+        void split(const Key& key, btree& right);
+        iterator upper_bound(const Key& key) const;
+        bool validate(thread_pool *pool = NULL) const;
+
+    protected:
+        typedef typename Allocator::template rebind<node>::other node_allocator;
+        enum set_op { SET_UNION, SET_INTERSECT, SET_DIFFERENCE };
+
+        /*
+            Result of validating one piece of the tree
+        */
+        struct piece_check {
+            bool ok;
+            const node *first; // smallest node of the piece, NULL if empty
+            const node *last; // largest node of the piece
+        };
+
+        node *build_balanced(const std::vector<item_type>& items, size_t lo, size_t hi);
+        void collect_keys(std::vector<Key>& keys) const;
+        void erase_node(node *leaf);
+        template <class F>
+        size_t erase_sorted(const std::vector<Key>& keys, F before_free);
+        static char *export_item(const node *leaf, char *first, char *last, btree_export_format format);
+        void free_node(node *leaf);
+        static int height(node *leaf);
+        node *insert(const Key& key, const Value& value, node *leaf, bool unique, node *&result);
+        node *join_nodes(node *left, node *mid, node *right);
+        node *join_trees(node *left, node *right);
+        node *link_balanced(const std::vector<node *>& nodes, size_t lo, size_t hi);
+        size_t rank(const Key& key, bool inclusive) const;
+        static item_type make_item(const Key& key);
+        static const item_type& make_item(const item_type& item);
+        node *new_node(const Key& key, const Value& value);
+        size_t piece_count() const;
+        node *rebalance(node *leaf);
+        node *rebalance_up(node *leaf);
+        void relink_balanced();
+        node *remove_min(node *leaf, node *&min);
+        void replace_child(node *parent, node *old_child, node *child);
+        static node *rotate_left(node *leaf);
+        static node *rotate_right(node *leaf);
+        static void set_left(node *leaf, node *child);
+        static void set_right(node *leaf, node *child);
+        node *set_operation(set_op op, node *a, node *b, std::vector<node *>& garbage, thread_pool *pool);
+        void set_operation(set_op op, btree& other, thread_pool *pool);
+        void set_root(node *leaf);
+        static size_t size(node *leaf);
+        void split_nodes(node *leaf, const Key& key, bool after, node *&left, node *&right);
+        void split_three(node *leaf, const Key& key, node *&less, node *&equal, node *&greater);
+        node *take_detached();
+        static void update_node(node *leaf);
+        static void update_path(node *leaf);
+        template <class F>
+        void walk_pieces(F f, thread_pool *pool) const;
+
+        static const size_t parallel_grain = 4096; // set operations and walks split smaller pieces on one thread
+        static const size_t parallel_pieces = 1024; // most pieces a walk is cut into
+
+        bool balanced; // AVL balancing on insert/erase
+        Compare comp;
+        node_allocator alloc; // owns every node in the tree
+        size_t count;
+        std::vector<node *> detached; // subtrees cut off by erase_range, freed lazily
+        node *root;
+
+    private:
+        btree(const btree&);
+        btree& operator=(const btree&);
+};
+
+// --------- BEGIN Iterator Functions --------------
+
+/*
+Function Name: operator++
+Description:
+    Moves to the next node in key order: the leftmost node
+    of the right subtree, or else the first ancestor that
+    is reached from its left side.
+Input(s):
+    None
+Return(s):
+    iterator - reference to this iterator.
+*/
+template <class Node>
+btree_iterator<Node>& btree_iterator<Node>::operator++() {
+    if (leaf->right != NULL) {
+        leaf = leaf->right;
+        while (leaf->left != NULL) leaf = leaf->left;
+    } else {
+        Node *child = leaf;
+        leaf = leaf->parent;
+        while ((leaf != NULL) && (leaf->right == child)) {
+            child = leaf;
+            leaf = leaf->parent;
+        }
+    }
+    return *this;
+}
+
+/*
+Function Name: operator++
+Description:
+    Post-increment. Moves to the next node in key order.
+Input(s):
+    None
+Return(s):
+    iterator - copy of the iterator before it moved.
+*/
+template <class Node>
+btree_iterator<Node> btree_iterator<Node>::operator++(int) {
+    btree_iterator old = *this;
+    ++(*this);
+    return old;
+}
+
+/*
+Function Name: operator--
+Description:
+    Moves to the previous node in key order. Stepping back
+    from end() lands on the largest node.
+Input(s):
+    None
+Return(s):
+    iterator - reference to this iterator.
+*/
+template <class Node>
+btree_iterator<Node>& btree_iterator<Node>::operator--() {
+    if (leaf == NULL) {
+        leaf = *root;
+        while (leaf->right != NULL) leaf = leaf->right;
+    } else if (leaf->left != NULL) {
+        leaf = leaf->left;
+        while (leaf->right != NULL) leaf = leaf->right;
+    } else {
+        Node *child = leaf;
+        leaf = leaf->parent;
+        while ((leaf != NULL) && (leaf->left == child)) {
+            child = leaf;
+            leaf = leaf->parent;
+        }
+    }
+    return *this;
+}
+
+/*
+Function Name: operator--
+Description:
+    Post-decrement. Moves to the previous node in key order.
+Input(s):
+    None
+Return(s):
+    iterator - copy of the iterator before it moved.
+*/
+template <class Node>
+btree_iterator<Node> btree_iterator<Node>::operator--(int) {
+    btree_iterator old = *this;
+    --(*this);
+    return old;
+}
+
+// --------- END Iterator Functions --------------
+
+// --------- BEGIN Pool Functions --------------
+
+/*
+Function Name: node_pool
+Description:
+    Node pool function that will be called when the pool
+    is allocated/created. No memory is reserved until the
+    first node is requested.
+Input(s):
+    chunk_nodes - size_t. number of nodes per chunk.
+Return(s):
+    None
+*/
+template <class T>
+node_pool<T>::node_pool(size_t chunk_nodes) : state(new pool_state((chunk_nodes > 0) ? chunk_nodes : 1)) {
+}
+
+/*
+Function Name: node_pool
+Description:
+    Copies a pool's chunk size into a new, empty pool.
+    Nodes are not shared unless the pools are joined with
+    adopt().
+Input(s):
+    other - node pool reference. pool to copy settings from.
+Return(s):
+    None
+*/
+template <class T>
+node_pool<T>::node_pool(const node_pool& other) : state(new pool_state(other.chunk_nodes())) {
+}
+
+/*
+Function Name: node_pool
+Description:
+    Copies the chunk size of a pool for another node type.
+    Used when a tree rebinds its allocator to its node type.
+Input(s):
+    other - node pool reference. pool to copy settings from.
+Return(s):
+    None
+*/
+template <class T>
+template <class U>
+node_pool<T>::node_pool(const node_pool<U>& other) : state(new pool_state(other.chunk_nodes())) {
+}
+
+/*
+Function Name: adopt
+Description:
+    Joins another pool into this one. Its chunks and free
+    nodes move here (the unused tail of its current chunk
+    goes on the free list) and from then on both pools hand
+    out and take back nodes from the same memory, so a node
+    allocated by either can be freed by either. Any other
+    pool still holding the joined state is forwarded here
+    the next time it is used.
+Input(s):
+    other - node pool reference. pool to join in.
+Return(s):
+    None
+*/
+template <class T>
+void node_pool<T>::adopt(node_pool& other) {
+    pool_state& mine = current();
+    pool_state& theirs = other.current();
+    if (&mine == &theirs) return;
+
+    if (!theirs.chunks.empty()) {
+        std::pair<T *, size_t> last = theirs.chunks.back();
+        for (size_t i = theirs.chunk_used; i < last.second; i++) deallocate(last.first + i);
+        // ours stay last so chunk_used still refers to our current chunk
+        bool had_chunks = !mine.chunks.empty();
+        mine.chunks.insert(mine.chunks.begin(), theirs.chunks.begin(), theirs.chunks.end());
+        if (!had_chunks) mine.chunk_used = last.second;
+        theirs.chunks.clear();
+    }
+    while (theirs.free_list != NULL) {
+        free_slot *slot = theirs.free_list;
+        theirs.free_list = slot->next;
+        deallocate(reinterpret_cast<T *>(slot));
+    }
+    theirs.chunk_used = theirs.chunk_size;
+    theirs.merged = state;
+    other.state = state;
+}
+
+/*
+Function Name: allocate
+Description:
+    Hands out memory for one node. Recycled nodes from the
+    free list are used first, then the next unused node of
+    the current chunk. A new chunk is only allocated when
+    both run out.
+Input(s):
+    None
+Return(s):
+    leaf - T pointer. uninitialized node memory.
+*/
+template <class T>
+T *node_pool<T>::allocate() {
+    static_assert(sizeof(T) >= sizeof(free_slot), "pool nodes must fit a free list link");
+    pool_state& pool = current();
+    if (pool.free_list != NULL) {
+        free_slot *slot = pool.free_list;
+        pool.free_list = slot->next;
+        return reinterpret_cast<T *>(slot);
+    }
+
+    if (pool.chunks.empty() || (pool.chunk_used == pool.chunks.back().second)) {
+        pool.chunks.push_back(std::make_pair(std::allocator<T>().allocate(pool.chunk_size), pool.chunk_size));
+        pool.chunk_used = 0;
+    }
+    return pool.chunks.back().first + pool.chunk_used++;
+}
+
+/*
+Function Name: chunk_nodes
+Description:
+    Gets the number of nodes carved out of each chunk.
+Input(s):
+    None
+Return(s):
+    chunk_size - size_t. nodes per chunk.
+*/
+template <class T>
+size_t node_pool<T>::chunk_nodes() const {
+    return current().chunk_size;
+}
+
+/*
+Function Name: current
+Description:
+    Gets the state the pool's memory lives in, following
+    the forwarding left by adopt() when the pool's state
+    was joined into another (possibly through another
+    pool). The pool is pointed straight at it afterwards.
+Input(s):
+    None
+Return(s):
+    pool - pool state reference. live state of the pool.
+*/
+template <class T>
+typename node_pool<T>::pool_state& node_pool<T>::current() const {
+    while (state->merged) {
+        std::shared_ptr<pool_state> next = state->merged;
+        state = next;
+    }
+    return *state;
+}
+
+/*
+Function Name: deallocate
+Description:
+    Returns a node to the pool by pushing it on the free list.
+Input(s):
+    leaf - T pointer. node memory that is no longer in use.
+Return(s):
+    None
+*/
+template <class T>
+void node_pool<T>::deallocate(T *leaf) {
+    pool_state& pool = current();
+    free_slot *slot = reinterpret_cast<free_slot *>(leaf);
+    slot->next = pool.free_list;
+    pool.free_list = slot;
+}
+
+/*
+Function Name: release
+Description:
+    Frees every chunk at once. All nodes handed out by the
+    pool become invalid, so this is only used when the whole
+    tree goes away. A pool joined with another through
+    adopt() can not do this while the other still uses it;
+    a state forwarding here counts as a user, since some
+    pool still holds it.
+Input(s):
+    None
+Return(s):
+    true - every node was released.
+    false - the memory is shared, free nodes one at a time.
+*/
+template <class T>
+bool node_pool<T>::release() {
+    pool_state& pool = current();
+    if (state.use_count() > 1) return false;
+
+    for (size_t i = 0; i < pool.chunks.size(); i++) std::allocator<T>().deallocate(pool.chunks[i].first, pool.chunks[i].second);
+    pool.chunks.clear();
+    pool.chunk_used = pool.chunk_size;
+    pool.free_list = NULL;
+    return true;
+}
+
+/*
+Function Name: allocate
+Description:
+    Allocates memory for one node on the heap.
+Input(s):
+    None
+Return(s):
+    leaf - T pointer. uninitialized node memory.
+*/
+template <class T>
+T *heap_allocator<T>::allocate() {
+    return std::allocator<T>().allocate(1);
+}
+
+/*
+Function Name: deallocate
+Description:
+    Frees the memory of one node.
+Input(s):
+    leaf - T pointer. node memory that is no longer in use.
+Return(s):
+    None
+*/
+template <class T>
+void heap_allocator<T>::deallocate(T *leaf) {
+    std::allocator<T>().deallocate(leaf, 1);
+}
+
+/*
+Function Name: release
+Description:
+    The heap allocator can not free nodes in bulk.
+Input(s):
+    None
+Return(s):
+    false - nodes have to be deallocated one at a time.
+*/
+template <class T>
+bool heap_allocator<T>::release() {
+    return false;
+}
+
+// --------- END Pool Functions --------------
+
+// --------- BEGIN Frozen Tree Functions --------------
+
+/*
+Function Name: frozen_btree
+Description:
+    Frozen tree function that will be called when the
+    snapshot is allocated/created. Starts out empty.
+Input(s):
+    None
+Return(s):
+    None
+*/
+template <class Key, class Compare>
+frozen_btree<Key, Compare>::frozen_btree() {
+    count = 0;
+}
+
+/*
+Function Name: build
+Description:
+    Lays out a sorted list of keys as a static B-tree.
+    Unused slots of the last blocks are padded with copies
+    of the largest key so every block stays sorted.
+Input(s):
+    keys - vector of keys. keys in ascending order.
+Return(s):
+    None
+*/
+template <class Key, class Compare>
+void frozen_btree<Key, Compare>::build(const std::vector<Key>& keys) {
+    count = keys.size();
+    blocks.assign((count + per_block - 1) / per_block, key_block());
+
+    size_t pos = 0;
+    build(keys, pos, 0);
+}
+
+/*
+Function Name: build
+Description:
+    Private function that fills one block and its subtrees
+    in key order: child 0, key 0, child 1, key 1, ...
+Input(s):
+    keys - vector of keys. keys in ascending order.
+    pos - size_t reference. next key to place.
+    block - size_t. block being filled.
+Return(s):
+    None
+*/
+template <class Key, class Compare>
+void frozen_btree<Key, Compare>::build(const std::vector<Key>& keys, size_t& pos, size_t block) {
+    if (block >= blocks.size()) return;
+
+    for (int i = 0; i < per_block; i++) {
+        build(keys, pos, child(block, i));
+        if (pos < keys.size()) blocks[block].keys[i] = keys[pos++];
+        else blocks[block].keys[i] = keys.back();
+    }
+    build(keys, pos, child(block, per_block));
+}
+
+/*
+Function Name: child
+Description:
+    Private function giving the index of a block's child.
+Input(s):
+    block - size_t. parent block.
+    i - integer. child number, 0 through per_block.
+Return(s):
+    child - size_t. index of the child block.
+*/
+template <class Key, class Compare>
+size_t frozen_btree<Key, Compare>::child(size_t block, int i) const {
+    return block * (per_block + 1) + i + 1;
+}
+
+/*
+Function Name: rank
+Description:
+    Private function to count the keys of a block that are
+    smaller than the search key.
+
+    For int keys with SSE2 the 16 keys are compared four at
+    a time and the comparison masks are counted with popcount.
+Input(s):
+    block - key_block reference. block to look in.
+    key - key reference. value being searched for.
+Return(s):
+    rank - integer. number of keys less than key.
+*/
+template <class Key, class Compare>
+int frozen_btree<Key, Compare>::rank(const key_block& block, const Key& key) const {
+#ifdef __SSE2__
+    if constexpr (std::is_same<Key, int>::value && std::is_same<Compare, std::less<int> >::value) {
+        __m128i x = _mm_set1_epi32(key);
+        const __m128i *k = reinterpret_cast<const __m128i *>(block.keys);
+        __m128i lt0 = _mm_cmpgt_epi32(x, _mm_load_si128(k));
+        __m128i lt1 = _mm_cmpgt_epi32(x, _mm_load_si128(k + 1));
+        __m128i lt2 = _mm_cmpgt_epi32(x, _mm_load_si128(k + 2));
+        __m128i lt3 = _mm_cmpgt_epi32(x, _mm_load_si128(k + 3));
+        __m128i lt01 = _mm_packs_epi32(lt0, lt1);
+        __m128i lt23 = _mm_packs_epi32(lt2, lt3);
+        int mask = _mm_movemask_epi8(_mm_packs_epi16(lt01, lt23));
+        return __builtin_popcount(mask);
+    }
+#endif
+    int n = 0;
+    for (int i = 0; i < per_block; i++) n += comp(block.keys[i], key) ? 1 : 0;
+    return n;
+}
+
+/*
+Function Name: maxKey
+Description:
+    Frozen tree function to get the maximum key value.
+    The padding of the last block already holds it.
+Input(s):
+    None
+Return(s):
+    max - key. maximum key value in tree.
+*/
+template <class Key, class Compare>
+Key frozen_btree<Key, Compare>::maxKey() const {
+    if (count == 0) return std::numeric_limits<Key>::max();
+
+    size_t block = 0;
+    size_t last = 0;
+    while (block < blocks.size()) {
+        last = block;
+        block = child(block, per_block);
+    }
+    return blocks[last].keys[per_block - 1];
+}
+
+/*
+Function Name: minKey
+Description:
+    Frozen tree function to get the minimum key value by
+    following the first child down to the bottom.
+Input(s):
+    None
+Return(s):
+    min - key. minimum key value in tree.
+*/
+template <class Key, class Compare>
+Key frozen_btree<Key, Compare>::minKey() const {
+    if (count == 0) return std::numeric_limits<Key>::min();
+
+    size_t block = 0;
+    size_t last = 0;
+    while (block < blocks.size()) {
+        last = block;
+        block = child(block, 0);
+    }
+    return blocks[last].keys[0];
+}
+
+/*
+Function Name: search
+Description:
+    Frozen tree function to search for a key value.
+
+    Descends one block per level, remembering the first
+    key not less than the search key. That key is the
+    answer if it matches.
+Input(s):
+    key - key reference. value to look for in tree.
+Return(s):
+    key - key pointer. key inside the snapshot.
+    NULL - value not found in tree.
+*/
+template <class Key, class Compare>
+const Key *frozen_btree<Key, Compare>::search(const Key& key) const {
+    const Key *found = NULL;
+    size_t block = 0;
+    while (block < blocks.size()) {
+        int i = rank(blocks[block], key);
+        if (i < per_block) found = &blocks[block].keys[i];
+        block = child(block, i);
+    }
+
+    if ((found != NULL) && !comp(key, *found)) return found;
+    return NULL;
+}
+
+/*
+Function Name: size
+Description:
+    Frozen tree function to get the number of keys.
+Input(s):
+    None
+Return(s):
+    count - size_t. number of keys in the snapshot.
+*/
+template <class Key, class Compare>
+size_t frozen_btree<Key, Compare>::size() const {
+    return count;
+}
+
+// --------- END Frozen Tree Functions --------------
+
+// --------- BEGIN Class Functions --------------
+
+/*
+Function Name: btree
+Description:
+    Binary tree function that will be called when the tree
+    is allocated/created.
+Input(s):
+    balance - bool. keep the tree AVL balanced on insert
+              and erase. pass false for the plain tree.
+    allocator - Allocator reference. node allocator settings.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+btree<Key, Value, Compare, Allocator>::btree(bool balance, const Allocator& allocator) : alloc(allocator) {
+    balanced = balance;
+    count = 0;
+    root = NULL;
+}
+
+/*
+Function Name: ~btree
+Description:
+    Binary tree function that will be called when the tree
+    is deallocated/destroyed.
+Input(s):
+    None
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+btree<Key, Value, Compare, Allocator>::~btree() {
+    destroy_tree();
+}
+
+// --------- PROTECTED Class Functions --------------
+
+/*
+Function Name: build_balanced
+Description:
+    Builds a perfectly balanced subtree out of a sorted
+    range of items. The middle item becomes the subtree
+    root and each half becomes a child.
+Input(s):
+    items - vector of items. sorted by key.
+    lo - size_t. first item of the range.
+    hi - size_t. one past the last item of the range.
+Return(s):
+    leaf - node pointer. root of the new subtree.
+    NULL - empty range.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::node *
+btree<Key, Value, Compare, Allocator>::build_balanced(const std::vector<item_type>& items, size_t lo, size_t hi) {
+    if (lo >= hi) return NULL;
+
+    size_t mid = lo + (hi - lo) / 2;
+    node *leaf = new_node(items[mid].first, items[mid].second);
+    set_left(leaf, build_balanced(items, lo, mid));
+    set_right(leaf, build_balanced(items, mid + 1, hi));
+    update_node(leaf);
+    return leaf;
+}
+
+/*
+Function Name: collect_keys
+Description:
+    Gathers every key in ascending order.
+
+    Uses an explicit stack of nodes instead of recursion so
+    a degenerate (unbalanced) tree can be walked safely.
+Input(s):
+    keys - vector of keys. receives the keys.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::collect_keys(std::vector<Key>& keys) const {
+    std::vector<node *> stack;
+    node *leaf = root;
+
+    while ((leaf != NULL) || !stack.empty()) {
+        while (leaf != NULL) {
+            stack.push_back(leaf);
+            leaf = leaf->left;
+        }
+        leaf = stack.back();
+        stack.pop_back();
+        keys.push_back(leaf->key);
+        leaf = leaf->right;
+    }
+}
+
+/*
+Function Name: erase_node
+Description:
+    Unlinks and frees a node that is in the tree.
+
+    A node with two children is replaced by its in-order
+    successor, found by walking down the right subtree from
+    the node, and relinked rather than copied. The tree is
+    then rebalanced from the lowest node whose subtree lost
+    a node up to the root, following parent links, so there
+    is no second search and no recursion.
+Input(s):
+    leaf - node pointer. node to remove.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::erase_node(node *leaf) {
+    node *parent = leaf->parent;
+    node *lowest = parent; // lowest node whose subtree changed
+
+    if ((leaf->left == NULL) || (leaf->right == NULL)) {
+        replace_child(parent, leaf, (leaf->left != NULL) ? leaf->left : leaf->right);
+    } else { // two children
+        node *next = leaf->right;
+        while (next->left != NULL) next = next->left;
+
+        if (next == leaf->right) {
+            lowest = next;
+        } else {
+            lowest = next->parent;
+            set_left(lowest, next->right);
+            set_right(next, leaf->right);
+        }
+        set_left(next, leaf->left);
+        replace_child(parent, leaf, next);
+    }
+
+    free_node(leaf);
+    if (lowest != NULL) set_root(rebalance_up(lowest));
+}
+
+/*
+Function Name: erase_sorted
+Description:
+    Removes every node whose key is in a sorted list of
+    unique keys.
+
+    A small batch is removed one key at a time, one search
+    each. A batch large enough that those searches would
+    cost more than a pass over the tree (keys * height >
+    size) is done in one merged in-order walk instead: the
+    nodes that survive are relinked, not copied, into a
+    perfectly balanced tree, so pointers to them stay valid.
+Input(s):
+    keys - vector of keys. sorted by Compare, no duplicates.
+    before_free - callable. called with each node just
+                  before it is freed.
+Return(s):
+    removed - size_t. nodes removed.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+template <class F>
+size_t btree<Key, Value, Compare, Allocator>::erase_sorted(const std::vector<Key>& keys, F before_free) {
+    size_t before = count;
+    if ((root == NULL) || keys.empty()) return 0;
+
+    if (keys.size() * (size_t)height(root) <= count) {
+        for (size_t i = 0; i < keys.size(); i++) {
+            node *leaf;
+            while ((leaf = search(keys[i])) != NULL) {
+                before_free(leaf);
+                erase_node(leaf);
+            }
+        }
+        return before - count;
+    }
+
+    std::vector<node *> kept;
+    std::vector<node *> doomed;
+    kept.reserve(count);
+    size_t k = 0;
+    for (iterator it = begin(); it != end(); ++it) {
+        while ((k < keys.size()) && comp(keys[k], it->key)) k++;
+        if ((k < keys.size()) && !comp(it->key, keys[k])) doomed.push_back(it.get());
+        else kept.push_back(it.get());
+    }
+    if (doomed.empty()) return 0;
+
+    for (size_t i = 0; i < doomed.size(); i++) {
+        before_free(doomed[i]);
+        free_node(doomed[i]);
+    }
+    set_root(link_balanced(kept, 0, kept.size()));
+    return before - count;
+}
+
+/*
+Function Name: export_item
+Description:
+    Formats one node for export_to().
+Input(s):
+    leaf - node pointer. node to format.
+    first - char pointer. where to start writing.
+    last - char pointer. end of the space available.
+    format - btree_export_format. text line or raw bytes.
+Return(s):
+    end - char pointer. end of the record.
+    NULL - the record does not fit in [first, last).
+*/
+template <class Key, class Value, class Compare, class Allocator>
+char *btree<Key, Value, Compare, Allocator>::export_item(const node *leaf, char *first, char *last, btree_export_format format) {
+    const bool has_value = !std::is_same<Value, btree_empty>::value;
+
+    if (format == BTREE_EXPORT_BINARY) {
+        static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+            "binary export needs trivially copyable keys and values");
+        size_t width = sizeof(Key) + (has_value ? sizeof(Value) : 0);
+        if ((size_t)(last - first) < width) return NULL;
+        std::memcpy(first, &leaf->key, sizeof(Key));
+        if (has_value) std::memcpy(first + sizeof(Key), &leaf->value, sizeof(Value));
+        return first + width;
+    }
+
+    first = btree_to_chars(first, last, leaf->key);
+    if (has_value && (first != NULL)) {
+        if (first == last) return NULL;
+        *first++ = ' ';
+        first = btree_to_chars(first, last, leaf->value);
+    }
+    if ((first == NULL) || (first == last)) return NULL;
+    *first++ = '\n';
+    return first;
+}
+
+/*
+Function Name: free_node
+Description:
+    Destroys a node and hands its memory back to the allocator.
+Input(s):
+    leaf - node pointer. node to free.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::free_node(node *leaf) {
+    leaf->~node();
+    alloc.deallocate(leaf);
+    count--;
+}
+
+/*
+Function Name: height
+Description:
+    Gets the height of a subtree.
+Input(s):
+    leaf - node pointer. root of the subtree.
+Return(s):
+    height - integer. 0 for an empty subtree.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+int btree<Key, Value, Compare, Allocator>::height(node *leaf) {
+    if (leaf != NULL) return leaf->height;
+    else return 0;
+}
+
+/*
+Function Name: insert
+Description:
+    Inserts a key into a subtree. Equal keys go to the left
+    unless unique is set, in which case the existing node is
+    returned instead. Each node on the path is rebalanced on
+    the way back up.
+Input(s):
+    key - key reference. key to insert.
+    value - value reference. mapped value for the key.
+    leaf - node pointer. current subtree root.
+    unique - bool. refuse to insert a key that already exists.
+    result - node pointer reference. receives the new node,
+             or the existing one when the key was refused.
+Return(s):
+    leaf - node pointer. new root of this subtree.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::node *
+btree<Key, Value, Compare, Allocator>::insert(const Key& key, const Value& value, node *leaf, bool unique, node *&result) {
+    if (leaf == NULL) {
+        result = new_node(key, value);
+        return result;
+    }
+
+    if (comp(leaf->key, key)) {
+        set_right(leaf, insert(key, value, leaf->right, unique, result));
+    } else if (unique && !comp(key, leaf->key)) {
+        result = leaf;
+        return leaf;
+    } else {
+        set_left(leaf, insert(key, value, leaf->left, unique, result));
+    }
+    return rebalance(leaf);
+}
+
+/*
+Function Name: join_nodes
+Description:
+    Joins two subtrees and a middle node, where every key
+    of left is before mid and every key of right after it.
+
+    The shorter subtree is hung off the side of the taller
+    one at the first node of about its height, with mid on
+    top, and the nodes above are rebalanced on the way back
+    up. Costs O(difference in height). The unbalanced tree
+    just puts mid on top.
+Input(s):
+    left - node pointer. subtree of smaller keys, may be NULL.
+    mid - node pointer. middle node, not linked anywhere.
+    right - node pointer. subtree of larger keys, may be NULL.
+Return(s):
+    leaf - node pointer. top of the joined subtree (its
+           parent link is not reset).
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::node *
+btree<Key, Value, Compare, Allocator>::join_nodes(node *left, node *mid, node *right) {
+    if (balanced) {
+        int lh = height(left);
+        int rh = height(right);
+        if (lh > rh + 1) {
+            set_right(left, join_nodes(left->right, mid, right));
+            return rebalance(left);
+        }
+        if (rh > lh + 1) {
+            set_left(right, join_nodes(left, mid, right->left));
+            return rebalance(right);
+        }
+    }
+    set_left(mid, left);
+    set_right(mid, right);
+    update_node(mid);
+    return mid;
+}
+
+/*
+Function Name: join_trees
+Description:
+    Joins two detached subtrees, every key of left before
+    every key of right, using the smallest node of right
+    as the middle node.
+Input(s):
+    left - node pointer. subtree of smaller keys, may be NULL.
+    right - node pointer. subtree of larger keys, may be NULL.
+Return(s):
+    leaf - node pointer. top of the joined subtree.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::node *
+btree<Key, Value, Compare, Allocator>::join_trees(node *left, node *right) {
+    if (left == NULL) return right;
+    if (right == NULL) return left;
+
+    node *mid = NULL;
+    right = remove_min(right, mid);
+    node *top = join_nodes(left, mid, right);
+    top->parent = NULL;
+    return top;
+}
+
+/*
+Function Name: link_balanced
+Description:
+    Relinks existing nodes, given in key order, into a
+    perfectly balanced subtree, like build_balanced() but
+    without allocating.
+Input(s):
+    nodes - vector of node pointers. in key order.
+    lo - size_t. first node of the range.
+    hi - size_t. one past the last node of the range.
+Return(s):
+    leaf - node pointer. root of the subtree.
+    NULL - empty range.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::node *
+btree<Key, Value, Compare, Allocator>::link_balanced(const std::vector<node *>& nodes, size_t lo, size_t hi) {
+    if (lo >= hi) return NULL;
+
+    size_t mid = lo + (hi - lo) / 2;
+    node *leaf = nodes[mid];
+    set_left(leaf, link_balanced(nodes, lo, mid));
+    set_right(leaf, link_balanced(nodes, mid + 1, hi));
+    update_node(leaf);
+    return leaf;
+}
+
+/*
+Function Name: make_item
+Description:
+    Turns a bare key into a (key, value) pair with a
+    default value.
+Input(s):
+    key - key reference. bare key.
+Return(s):
+    item - item. (key, Value()) pair.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::item_type
+btree<Key, Value, Compare, Allocator>::make_item(const Key& key) {
+    return item_type(key, Value());
+}
+
+/*
+Function Name: make_item
+Description:
+    Passes a (key, value) pair through unchanged.
+Input(s):
+    item - item reference. (key, value) pair.
+Return(s):
+    item - item reference. the same pair.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+const typename btree<Key, Value, Compare, Allocator>::item_type&
+btree<Key, Value, Compare, Allocator>::make_item(const item_type& item) {
+    return item;
+}
+
+/*
+Function Name: new_node
+Description:
+    Allocates and constructs a new leaf node, reusing the
+    memory of a node cut off by erase_range() if one is
+    waiting to be freed.
+Input(s):
+    key - key reference. key for the new node.
+    value - value reference. mapped value for the new node.
+Return(s):
+    leaf - node pointer. the new node.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::node *
+btree<Key, Value, Compare, Allocator>::new_node(const Key& key, const Value& value) {
+    node *memory = detached.empty() ? alloc.allocate() : take_detached();
+    node *leaf = new (memory) node(key, value);
+    count++;
+    return leaf;
+}
+
+/*
+Function Name: piece_count
+Description:
+    Gets how many pieces walk_pieces() cuts the tree into:
+    one per parallel_grain keys, at most parallel_pieces.
+Input(s):
+    None
+Return(s):
+    pieces - size_t. 0 for an empty tree.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+size_t btree<Key, Value, Compare, Allocator>::piece_count() const {
+    size_t pieces = (count + parallel_grain - 1) / parallel_grain;
+    if (pieces > parallel_pieces) pieces = parallel_pieces;
+    return pieces;
+}
+
+/*
+Function Name: rank
+Description:
+    Counts the keys less than (or, when inclusive, not
+    greater than) the given key in one walk down the tree,
+    adding up the left subtree sizes passed on the way.
+Input(s):
+    key - key reference. key to rank.
+    inclusive - bool. also count keys equal to key.
+Return(s):
+    rank - size_t. number of keys counted.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+size_t btree<Key, Value, Compare, Allocator>::rank(const Key& key, bool inclusive) const {
+    size_t below = 0;
+    node *leaf = root;
+    while (leaf != NULL) {
+        bool right = inclusive ? !comp(key, leaf->key) : comp(leaf->key, key);
+        if (right) {
+            below += size(leaf->left) + 1;
+            leaf = leaf->right;
+        } else {
+            leaf = leaf->left;
+        }
+    }
+    return below;
+}
+
+/*
+Function Name: rebalance
+Description:
+    Restores the AVL property at a node after one of its
+    subtrees has changed.
+
+    Does nothing but update the height when the tree
+    was created without balancing.
+Input(s):
+    leaf - node pointer. node to rebalance.
+Return(s):
+    leaf - node pointer. new root of this subtree.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::node *
+btree<Key, Value, Compare, Allocator>::rebalance(node *leaf) {
+    update_node(leaf);
+    if (!balanced) return leaf;
+
+    int balance = height(leaf->left) - height(leaf->right);
+    if (balance > 1) {
+        if (height(leaf->left->left) < height(leaf->left->right))
+            set_left(leaf, rotate_left(leaf->left));
+        return rotate_right(leaf);
+    } else if (balance < -1) {
+        if (height(leaf->right->right) < height(leaf->right->left))
+            set_right(leaf, rotate_right(leaf->right));
+        return rotate_left(leaf);
+    }
+    return leaf;
+}
+
+/*
+Function Name: rebalance_up
+Description:
+    Rebalances every node from leaf up to the top of its
+    tree (the node with no parent), relinking each
+    rebalanced subtree to its parent. Height, size and
+    summary are refreshed all the way up, since a removed
+    node changes the size of every ancestor.
+Input(s):
+    leaf - node pointer. lowest node to rebalance, may be NULL.
+Return(s):
+    top - node pointer. new top of the tree, NULL if leaf was.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::node *
+btree<Key, Value, Compare, Allocator>::rebalance_up(node *leaf) {
+    node *top = leaf;
+    while (leaf != NULL) {
+        node *parent = leaf->parent;
+        bool left = (parent != NULL) && (parent->left == leaf);
+        top = rebalance(leaf);
+        if (parent == NULL) top->parent = NULL;
+        else if (left) set_left(parent, top);
+        else set_right(parent, top);
+        leaf = parent;
+    }
+    return top;
+}
+
+/*
+Function Name: relink_balanced
+Description:
+    Relinks every node of the tree, in key order and
+    without copying, into a perfectly balanced tree, so
+    pointers to the nodes stay valid. O(n); the iterators
+    walk the tree without recursion, so any shape is safe.
+Input(s):
+    None
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::relink_balanced() {
+    std::vector<node *> nodes;
+    nodes.reserve(count);
+    for (iterator it = begin(); it != end(); ++it) nodes.push_back(it.get());
+    set_root(link_balanced(nodes, 0, nodes.size()));
+}
+
+/*
+Function Name: remove_min
+Description:
+    Unlinks the smallest node of a detached subtree (one
+    whose top has no parent) without freeing it, walking
+    down the left spine and rebalancing back up.
+Input(s):
+    leaf - node pointer. top of the subtree, not NULL.
+    min - node pointer reference. receives the unlinked node.
+Return(s):
+    leaf - node pointer. new top of the subtree.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::node *
+btree<Key, Value, Compare, Allocator>::remove_min(node *leaf, node *&min) {
+    min = leaf;
+    while (min->left != NULL) min = min->left;
+
+    if (min == leaf) {
+        if (min->right != NULL) min->right->parent = NULL;
+        return min->right;
+    }
+    node *parent = min->parent;
+    set_left(parent, min->right);
+    return rebalance_up(parent);
+}
+
+/*
+Function Name: replace_child
+Description:
+    Puts child where old_child was under parent (or at the
+    root when parent is NULL).
+Input(s):
+    parent - node pointer. parent of old_child, may be NULL.
+    old_child - node pointer. node being replaced.
+    child - node pointer. replacement, may be NULL.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::replace_child(node *parent, node *old_child, node *child) {
+    if (parent == NULL) set_root(child);
+    else if (parent->left == old_child) set_left(parent, child);
+    else set_right(parent, child);
+}
+
+/*
+Function Name: rotate_left
+Description:
+    Rotates a subtree to the left. The right child becomes
+    the new subtree root; the caller links it to the parent.
+Input(s):
+    leaf - node pointer. current subtree root.
+Return(s):
+    pivot - node pointer. new subtree root.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::node *
+btree<Key, Value, Compare, Allocator>::rotate_left(node *leaf) {
+    node *pivot = leaf->right;
+    set_right(leaf, pivot->left);
+    set_left(pivot, leaf);
+    update_node(leaf);
+    update_node(pivot);
+    return pivot;
+}
+
+/*
+Function Name: rotate_right
+Description:
+    Rotates a subtree to the right. The left child becomes
+    the new subtree root; the caller links it to the parent.
+Input(s):
+    leaf - node pointer. current subtree root.
+Return(s):
+    pivot - node pointer. new subtree root.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::node *
+btree<Key, Value, Compare, Allocator>::rotate_right(node *leaf) {
+    node *pivot = leaf->left;
+    set_left(leaf, pivot->right);
+    set_right(pivot, leaf);
+    update_node(leaf);
+    update_node(pivot);
+    return pivot;
+}
+
+/*
+Function Name: set_left
+Description:
+    Makes a node the left child of another and points the
+    child back at its new parent.
+Input(s):
+    leaf - node pointer. parent node.
+    child - node pointer. new left child, may be NULL.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::set_left(node *leaf, node *child) {
+    leaf->left = child;
+    if (child != NULL) child->parent = leaf;
+}
+
+/*
+Function Name: set_right
+Description:
+    Makes a node the right child of another and points the
+    child back at its new parent.
+Input(s):
+    leaf - node pointer. parent node.
+    child - node pointer. new right child, may be NULL.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::set_right(node *leaf, node *child) {
+    leaf->right = child;
+    if (child != NULL) child->parent = leaf;
+}
+
+/*
+Function Name: set_operation
+Description:
+    Union, intersection or difference of two detached
+    subtrees, built on split and join.
+
+    b is split around the top key of a. The two halves are
+    combined with a's children recursively, then joined back
+    with a's top node in the middle, or without it when the
+    operation drops that key. This does O(m log(n / m + 1))
+    work for trees of m <= n nodes. When a thread pool is
+    given and the subtrees are large, the two halves run in
+    parallel; they touch disjoint nodes, so no locking is
+    needed. Nodes that drop out are not freed here (the
+    allocator is not thread safe) but handed back in garbage.
+Input(s):
+    op - set_op. SET_UNION, SET_INTERSECT or SET_DIFFERENCE.
+    a - node pointer. subtree whose nodes win on equal keys.
+    b - node pointer. the other subtree.
+    garbage - vector of node pointers. receives the
+              subtrees that drop out.
+    pool - thread_pool pointer. NULL to stay on this thread.
+Return(s):
+    leaf - node pointer. top of the result, parent reset.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::node *
+btree<Key, Value, Compare, Allocator>::set_operation(set_op op, node *a, node *b, std::vector<node *>& garbage, thread_pool *pool) {
+    if ((a == NULL) || (b == NULL)) {
+        node *top = a;
+        if (op == SET_UNION) {
+            if (a == NULL) top = b;
+        } else if (op == SET_INTERSECT) {
+            if (a != NULL) garbage.push_back(a);
+            if (b != NULL) garbage.push_back(b);
+            top = NULL;
+        } else if (b != NULL) {
+            garbage.push_back(b);
+        }
+        if (top != NULL) top->parent = NULL;
+        return top;
+    }
+
+    bool parallel = (pool != NULL) && (size(a) + size(b) > parallel_grain);
+    node *less = NULL;
+    node *equal = NULL;
+    node *greater = NULL;
+    split_three(b, a->key, less, equal, greater);
+
+    node *lhs = a->left;
+    node *rhs = a->right;
+    if (lhs != NULL) lhs->parent = NULL;
+    if (rhs != NULL) rhs->parent = NULL;
+
+    node *left = NULL;
+    node *right = NULL;
+    if (parallel) {
+        std::vector<node *> more;
+        pool->run(2, [&](size_t i) {
+            if (i == 0) left = set_operation(op, lhs, less, garbage, pool);
+            else right = set_operation(op, rhs, greater, more, pool);
+        });
+        garbage.insert(garbage.end(), more.begin(), more.end());
+    } else {
+        left = set_operation(op, lhs, less, garbage, pool);
+        right = set_operation(op, rhs, greater, garbage, pool);
+    }
+
+    if (equal != NULL) garbage.push_back(equal);
+    bool keep = (op == SET_UNION) || ((op == SET_INTERSECT) == (equal != NULL));
+    node *top;
+    if (keep) {
+        top = join_nodes(left, a, right);
+    } else {
+        a->left = NULL;
+        a->right = NULL;
+        garbage.push_back(a);
+        top = join_trees(left, right);
+    }
+    if (top != NULL) top->parent = NULL;
+    return top;
+}
+
+/*
+Function Name: set_operation
+Description:
+    Replaces this tree with its union, intersection or
+    difference with another tree, taking the other tree's
+    nodes. The node pools are joined first (node_pool::adopt)
+    so every node can be freed by this tree. Nodes that drop
+    out are queued like erase_range() leftovers, reused by
+    later inserts or freed by reclaim().
+    Meant for trees of unique keys (insert_unique); with
+    duplicates only the top copy of a key is matched.
+    The recursion goes as deep as this tree is tall and the
+    joins expect AVL shaped pieces, so a tree made without
+    balancing is relinked into a balanced one first.
+Input(s):
+    op - set_op. SET_UNION, SET_INTERSECT or SET_DIFFERENCE.
+    other - tree reference. left empty.
+    pool - thread_pool pointer. NULL to stay on this thread.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::set_operation(set_op op, btree& other, thread_pool *pool) {
+    if (&other == this) return;
+
+    alloc.adopt(other.alloc);
+    if (!balanced) relink_balanced();
+    if (!other.balanced) other.relink_balanced();
+    std::vector<node *> garbage;
+    node *top = set_operation(op, root, other.root, garbage, pool);
+    other.root = NULL;
+    other.count = 0;
+
+    set_root(top);
+    count = size(top);
+    detached.insert(detached.end(), garbage.begin(), garbage.end());
+}
+
+/*
+Function Name: set_root
+Description:
+    Makes a node the root of the tree.
+Input(s):
+    leaf - node pointer. new root, may be NULL.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::set_root(node *leaf) {
+    root = leaf;
+    if (leaf != NULL) leaf->parent = NULL;
+}
+
+/*
+Function Name: size
+Description:
+    Gets the number of nodes in a subtree.
+Input(s):
+    leaf - node pointer. root of the subtree.
+Return(s):
+    size - size_t. 0 for an empty subtree.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+size_t btree<Key, Value, Compare, Allocator>::size(node *leaf) {
+    if (leaf != NULL) return leaf->size;
+    else return 0;
+}
+
+/*
+Function Name: split_nodes
+Description:
+    Splits a detached subtree in two by a key, without
+    allocating or copying. The nodes on the search path are
+    collected going down; coming back up, each one is joined
+    with the side it belongs to, so the two halves come out
+    balanced in O(log n) total.
+Input(s):
+    leaf - node pointer. top of the subtree, may be NULL.
+    key - key reference. where to split.
+    after - bool. false: keys before key go left, the rest
+            right. true: keys up to and including key go
+            left, the rest right.
+    left - node pointer reference. receives the left half.
+    right - node pointer reference. receives the right half.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::split_nodes(node *leaf, const Key& key, bool after, node *&left, node *&right) {
+    std::vector<node *> path;
+    while (leaf != NULL) {
+        path.push_back(leaf);
+        bool goes_left = after ? !comp(key, leaf->key) : comp(leaf->key, key);
+        leaf = goes_left ? leaf->right : leaf->left;
+    }
+
+    left = NULL;
+    right = NULL;
+    for (size_t i = path.size(); i-- > 0; ) {
+        node *cut = path[i];
+        bool goes_left = after ? !comp(key, cut->key) : comp(cut->key, key);
+        if (goes_left) left = join_nodes(cut->left, cut, left);
+        else right = join_nodes(right, cut, cut->right);
+    }
+    if (left != NULL) left->parent = NULL;
+    if (right != NULL) right->parent = NULL;
+}
+
+/*
+Function Name: split_three
+Description:
+    Splits a detached subtree into the keys before key,
+    the keys equal to it and the keys after it.
+Input(s):
+    leaf - node pointer. top of the subtree, may be NULL.
+    key - key reference. where to split.
+    less - node pointer reference. receives keys < key.
+    equal - node pointer reference. receives keys == key.
+    greater - node pointer reference. receives keys > key.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::split_three(node *leaf, const Key& key, node *&less, node *&equal, node *&greater) {
+    node *rest = NULL;
+    split_nodes(leaf, key, false, less, rest);
+    split_nodes(rest, key, true, equal, greater);
+}
+
+/*
+Function Name: take_detached
+Description:
+    Takes one node off the subtrees waiting to be freed,
+    putting its children back on the list, and destroys it
+    so its memory can be reused. Spreads the cost of an
+    erase_range() over later inserts, one node each.
+Input(s):
+    None
+Return(s):
+    leaf - node pointer. raw memory for one node.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::node *
+btree<Key, Value, Compare, Allocator>::take_detached() {
+    node *leaf = detached.back();
+    detached.pop_back();
+    if (leaf->left != NULL) detached.push_back(leaf->left);
+    if (leaf->right != NULL) detached.push_back(leaf->right);
+    leaf->~node();
+    return leaf;
+}
+
+/*
+Function Name: update_node
+Description:
+    Recomputes the height, subtree size and subtree summary
+    of a node from those of its children.
+Input(s):
+    leaf - node pointer. node to update.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::update_node(node *leaf) {
+    int lh = height(leaf->left);
+    int rh = height(leaf->right);
+    leaf->height = (lh > rh ? lh : rh) + 1;
+    leaf->size = size(leaf->left) + size(leaf->right) + 1;
+
+    if constexpr (!std::is_same<summary_type, btree_empty>::value) {
+        leaf->summary = summary_traits::of(leaf->key, leaf->value);
+        if (leaf->left != NULL) summary_traits::merge(leaf->summary, leaf->left->summary);
+        if (leaf->right != NULL) summary_traits::merge(leaf->summary, leaf->right->summary);
+    }
+}
+
+/*
+Function Name: update_path
+Description:
+    Recomputes height, size and summary from a node up to
+    the root.
+    Used after the unbalanced tree links in a new leaf
+    without recursing.
+Input(s):
+    leaf - node pointer. lowest node that changed.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::update_path(node *leaf) {
+    while (leaf != NULL) {
+        update_node(leaf);
+        leaf = leaf->parent;
+    }
+}
+
+/*
+Function Name: walk_pieces
+Description:
+    Cuts the tree by rank into pieces of about
+    parallel_grain consecutive keys (at most
+    parallel_pieces of them) and calls f once per piece,
+    across a thread pool when one is given. Each piece
+    starts with select(), O(log n), then steps through
+    its keys in order.
+Input(s):
+    f - callable. called as f(piece, first, n) with the
+        piece number, an iterator to its first key and
+        its number of keys.
+    pool - thread_pool pointer. NULL to run in order on
+           this thread.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+template <class F>
+void btree<Key, Value, Compare, Allocator>::walk_pieces(F f, thread_pool *pool) const {
+    size_t pieces = piece_count();
+    parallel_run(pool, pieces, [&](size_t i) {
+        size_t first = i * count / pieces;
+        size_t last = (i + 1) * count / pieces;
+        f(i, iterator(select(first), &root), last - first);
+    });
+}
+
+// --------- PUBLIC Class Functions --------------
+
+/*
+Function Name: aggregate
+Description:
+    Summarizes the keys from lo through hi (inclusive) in
+    O(log n) using the subtree summaries.
+
+    The walk goes down to the highest node inside the range,
+    then follows the lo and hi boundaries below it. Along the
+    lo boundary every in-range node adds itself and its whole
+    right subtree; along the hi boundary, itself and its whole
+    left subtree. Nodes outside the range are stepped past.
+Input(s):
+    lo - key reference. smallest key to include.
+    hi - key reference. largest key to include.
+Return(s):
+    summary - summary_type. empty summary if no key is in range.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::summary_type
+btree<Key, Value, Compare, Allocator>::aggregate(const Key& lo, const Key& hi) const {
+    summary_type result = summary_type();
+    if (comp(hi, lo)) return result;
+
+    node *split = root;
+    while (split != NULL) {
+        if (comp(split->key, lo)) split = split->right;
+        else if (comp(hi, split->key)) split = split->left;
+        else break;
+    }
+    if (split == NULL) return result;
+    summary_traits::merge(result, summary_traits::of(split->key, split->value));
+
+    for (node *leaf = split->left; leaf != NULL; ) {
+        if (comp(leaf->key, lo)) {
+            leaf = leaf->right;
+        } else {
+            summary_traits::merge(result, summary_traits::of(leaf->key, leaf->value));
+            if (leaf->right != NULL) summary_traits::merge(result, leaf->right->summary);
+            leaf = leaf->left;
+        }
+    }
+
+    for (node *leaf = split->right; leaf != NULL; ) {
+        if (comp(hi, leaf->key)) {
+            leaf = leaf->left;
+        } else {
+            summary_traits::merge(result, summary_traits::of(leaf->key, leaf->value));
+            if (leaf->left != NULL) summary_traits::merge(result, leaf->left->summary);
+            leaf = leaf->right;
+        }
+    }
+    return result;
+}
+
+/*
+Function Name: begin
+Description:
+    Gets an iterator to the smallest key.
+Input(s):
+    None
+Return(s):
+    iterator - first node in key order, end() if empty.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::iterator
+btree<Key, Value, Compare, Allocator>::begin() const {
+    return iterator(min_node(), &root);
+}
+
+/*
+Function Name: build_from
+Description:
+    Replaces the contents of the tree with a range of keys
+    or (key, value) pairs.
+
+    The items are sorted only if they are not sorted already
+    (stable, so the first of several equal keys stays first),
+    then the tree is built directly in linear time without
+    going through insert.
+Input(s):
+    first - input iterator. first item of the range.
+    last - input iterator. one past the last item.
+    unique - bool. drop duplicate keys, keeping the first one.
+Return(s):
+    dups - size_t. number of duplicate keys in the range.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+template <class InputIt>
+size_t btree<Key, Value, Compare, Allocator>::build_from(InputIt first, InputIt last, bool unique) {
+    std::vector<item_type> items;
+    for (; first != last; ++first) items.push_back(make_item(*first));
+
+    Compare c = comp;
+    auto before = [c](const item_type& a, const item_type& b) { return c(a.first, b.first); };
+    if (!std::is_sorted(items.begin(), items.end(), before))
+        std::stable_sort(items.begin(), items.end(), before);
+
+    size_t kept = 0;
+    size_t dups = 0;
+    for (size_t i = 0; i < items.size(); i++) {
+        if ((i > 0) && !comp(items[i - 1].first, items[i].first)) {
+            dups++;
+            if (unique) continue;
+        }
+        if (kept != i) items[kept] = items[i];
+        kept++;
+    }
+    items.resize(kept);
+
+    destroy_tree();
+    set_root(build_balanced(items, 0, items.size()));
+    return dups;
+}
+
+/*
+Function Name: count_range
+Description:
+    Counts the keys from lo through hi (inclusive) in two
+    walks down the tree.
+Input(s):
+    lo - key reference. smallest key to count.
+    hi - key reference. largest key to count.
+Return(s):
+    count - size_t. number of keys in [lo, hi].
+*/
+template <class Key, class Value, class Compare, class Allocator>
+size_t btree<Key, Value, Compare, Allocator>::count_range(const Key& lo, const Key& hi) const {
+    if (comp(hi, lo)) return 0;
+    return rank(hi, true) - rank(lo, false);
+}
+
+/*
+Function Name: destroy_tree
+Description:
+    Frees every node in the tree.
+
+    When the nodes need no destructor and the allocator can
+    release all of its memory at once (node_pool), the tree
+    and any subtrees still waiting to be freed are dropped
+    without being walked. Otherwise left children
+    are rotated up until the current node has no left child,
+    which is then freed, so the walk stays iterative even on
+    a degenerate tree.
+Input(s):
+    None
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::destroy_tree() {
+    if (!std::is_trivially_destructible<node>::value || !alloc.release()) {
+        node *leaf = root;
+        while (leaf != NULL) {
+            if (leaf->left != NULL) {
+                leaf = rotate_right(leaf);
+            } else {
+                node *temp = leaf->right;
+                free_node(leaf);
+                leaf = temp;
+            }
+        }
+        reclaim();
+        alloc.release();
+    }
+    count = 0;
+    detached.clear();
+    root = NULL;
+}
+
+/*
+Function Name: difference
+Description:
+    Removes every key that is also in another tree (set
+    difference), in O(m log(n / m + 1)). other is left
+    empty. Pass a thread pool to split the work across it.
+Input(s):
+    other - tree reference. keys to remove. left empty.
+    pool - thread_pool pointer. NULL to run on this thread.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::difference(btree& other, thread_pool *pool) {
+    set_operation(SET_DIFFERENCE, other, pool);
+}
+
+/*
+Function Name: display_tree
+Description:
+    Displays the binary tree from low to high, or prints a
+    message telling the user that the tree is empty.
+Input(s):
+    None
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::display_tree() {
+    if (root == NULL) {
+        std::cout << "Tree Is Empty. Nothing To Display" << std::endl;
+        return;
+    }
+    for (iterator it = begin(); it != end(); ++it) std::cout << it->key << '\n';
+    std::cout.flush();
+}
+
+/*
+Function Name: display_tree_rev
+Description:
+    Displays the binary tree from high to low, or prints a
+    message telling the user that the tree is empty.
+Input(s):
+    None
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::display_tree_rev() {
+    if (root == NULL) {
+        std::cout << "Tree Is Empty. Nothing To Display" << std::endl;
+        return;
+    }
+    for (reverse_iterator it = rbegin(); it != rend(); ++it) std::cout << it->key << '\n';
+    std::cout.flush();
+}
+
+/*
+Function Name: empty
+Description:
+    Checks whether the tree has any nodes.
+Input(s):
+    None
+Return(s):
+    true - the tree is empty.
+    false - the tree has at least one node.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+bool btree<Key, Value, Compare, Allocator>::empty() const {
+    return root == NULL;
+}
+
+/*
+Function Name: end
+Description:
+    Gets the iterator one past the largest key.
+Input(s):
+    None
+Return(s):
+    iterator - past-the-end iterator.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::iterator
+btree<Key, Value, Compare, Allocator>::end() const {
+    return iterator(NULL, &root);
+}
+
+/*
+Function Name: equal_range
+Description:
+    Gets the range of nodes whose key equals the given key.
+Input(s):
+    key - key reference. key to look for.
+Return(s):
+    (first, last) - iterators bounding the equal keys.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+std::pair<typename btree<Key, Value, Compare, Allocator>::iterator,
+          typename btree<Key, Value, Compare, Allocator>::iterator>
+btree<Key, Value, Compare, Allocator>::equal_range(const Key& key) const {
+    return std::make_pair(lower_bound(key), upper_bound(key));
+}
+
+/*
+Function Name: erase
+Description:
+    Removes one node with the given key: one search down,
+    then one rebalancing walk back up the parent links.
+Input(s):
+    key - key reference. key to remove.
+Return(s):
+    true - a node was removed.
+    false - the key was not in the tree.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+bool btree<Key, Value, Compare, Allocator>::erase(const Key& key) {
+    node *leaf = search(key);
+    if (leaf == NULL) return false;
+    erase_node(leaf);
+    return true;
+}
+
+/*
+Function Name: erase_keys
+Description:
+    Removes every node whose key is in a batch. The batch
+    is sorted and deduplicated, then removed as described
+    in erase_sorted().
+Input(s):
+    first - input iterator. first key of the batch.
+    last - input iterator. one past the last key.
+Return(s):
+    removed - size_t. nodes removed.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+template <class InputIt>
+size_t btree<Key, Value, Compare, Allocator>::erase_keys(InputIt first, InputIt last) {
+    std::vector<Key> keys(first, last);
+    Compare c = comp;
+    std::sort(keys.begin(), keys.end(), c);
+    keys.erase(std::unique(keys.begin(), keys.end(), [c](const Key& a, const Key& b) { return !c(a, b) && !c(b, a); }), keys.end());
+    return erase_sorted(keys, [](node *) {});
+}
+
+/*
+Function Name: erase_range
+Description:
+    Removes every key from lo through hi (inclusive) in
+    O(log n): the range is split off as one subtree and the
+    two outer parts are joined back together. The removed
+    nodes are not walked here; their memory is reused by
+    later inserts one node at a time, or freed all at once
+    by reclaim() or destroy_tree(). Pointers to removed
+    nodes are invalid as soon as this returns.
+Input(s):
+    lo - key reference. smallest key to remove.
+    hi - key reference. largest key to remove.
+Return(s):
+    removed - size_t. nodes removed.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+size_t btree<Key, Value, Compare, Allocator>::erase_range(const Key& lo, const Key& hi) {
+    if ((root == NULL) || comp(hi, lo)) return 0;
+
+    node *below = NULL;
+    node *rest = NULL;
+    node *middle = NULL;
+    node *above = NULL;
+    split_nodes(root, lo, false, below, rest);
+    split_nodes(rest, hi, true, middle, above);
+    set_root(join_trees(below, above));
+
+    size_t removed = size(middle);
+    if (middle != NULL) detached.push_back(middle);
+    count -= removed;
+    return removed;
+}
+
+/*
+Function Name: export_to
+Description:
+    Writes nodes in key order into a caller supplied buffer,
+    starting at first, until the next record does not fit.
+    first is left on the first node not written, so calling
+    again with the same iterator carries on from there; the
+    export is done once first == end().
+Input(s):
+    first - iterator reference. first node to write.
+    buffer - char pointer. where to write.
+    capacity - size_t. size of the buffer in bytes.
+    format - btree_export_format. text lines or raw bytes.
+Return(s):
+    bytes - size_t. bytes written. 0 with first != end()
+            means one record is larger than the buffer.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+size_t btree<Key, Value, Compare, Allocator>::export_to(iterator& first, char *buffer, size_t capacity, btree_export_format format) const {
+    char *pos = buffer;
+    char *last = buffer + capacity;
+    iterator stop = end();
+    while (first != stop) {
+        char *next = export_item(first.get(), pos, last, format);
+        if (next == NULL) break;
+        pos = next;
+        ++first;
+    }
+    return pos - buffer;
+}
+
+/*
+Function Name: export_to
+Description:
+    Writes the whole tree in key order to a file descriptor.
+    Records are batched into a 1MB buffer, so a dump of
+    millions of keys takes one write() per megabyte instead
+    of one flush per key.
+Input(s):
+    fd - int. open file descriptor to write to.
+    format - btree_export_format. text lines or raw bytes.
+Return(s):
+    true - every node was written.
+    false - write() failed (errno is left set) or a record
+            was larger than the buffer.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+bool btree<Key, Value, Compare, Allocator>::export_to(int fd, btree_export_format format) const {
+    std::vector<char> buffer(1 << 20);
+    iterator it = begin();
+    while (it != end()) {
+        size_t bytes = export_to(it, &buffer[0], buffer.size(), format);
+        if (bytes == 0) return false;
+
+        const char *pos = &buffer[0];
+        while (bytes > 0) {
+            ssize_t written = ::write(fd, pos, bytes);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            pos += written;
+            bytes -= written;
+        }
+    }
+    return true;
+}
+
+/*
+Function Name: freeze
+Description:
+    Builds a read-only snapshot of the keys for fast
+    searching.
+
+    The snapshot does not follow later inserts; call
+    freeze again to rebuild it after the tree changes.
+Input(s):
+    None
+Return(s):
+    frozen - frozen_btree. snapshot of the current keys.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+frozen_btree<Key, Compare> btree<Key, Value, Compare, Allocator>::freeze() const {
+    std::vector<Key> keys;
+    keys.reserve(count);
+    collect_keys(keys);
+
+    frozen_btree<Key, Compare> frozen;
+    frozen.build(keys);
+    return frozen;
+}
+
+/*
+Function Name: height
+Description:
+    Gets the height of the tree.
+Input(s):
+    None
+Return(s):
+    height - integer. 0 for an empty tree.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+int btree<Key, Value, Compare, Allocator>::height() const {
+    return height(root);
+}
+
+/*
+Function Name: insert
+Description:
+    Inserts a key into the tree. Keys that are already in
+    the tree are added again (to the left of the existing
+    ones).
+
+    The unbalanced tree is walked iteratively since its
+    height can grow to the number of keys.
+Input(s):
+    key - key reference. key to insert.
+    value - value reference. mapped value for the key.
+Return(s):
+    leaf - node pointer. the new node.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::node *
+btree<Key, Value, Compare, Allocator>::insert(const Key& key, const Value& value) {
+    node *result = NULL;
+    if (balanced || root == NULL) {
+        set_root(insert(key, value, root, false, result));
+        return result;
+    }
+
+    node *leaf = root;
+    while (true) {
+        node *&next = comp(leaf->key, key) ? leaf->right : leaf->left;
+        if (next == NULL) {
+            next = new_node(key, value);
+            next->parent = leaf;
+            update_path(leaf);
+            return next;
+        }
+        leaf = next;
+    }
+}
+
+/*
+Function Name: insert_unique
+Description:
+    Inserts a key into the tree unless it is already there.
+Input(s):
+    key - key reference. key to insert.
+    value - value reference. mapped value for the key.
+Return(s):
+    (leaf, true) - the new node.
+    (leaf, false) - the node that already holds the key.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+std::pair<typename btree<Key, Value, Compare, Allocator>::node *, bool>
+btree<Key, Value, Compare, Allocator>::insert_unique(const Key& key, const Value& value) {
+    size_t before = count;
+    node *result = NULL;
+    if (balanced || root == NULL) {
+        set_root(insert(key, value, root, true, result));
+        return std::make_pair(result, count != before);
+    }
+
+    node *leaf = root;
+    while (true) {
+        bool right = comp(leaf->key, key);
+        if (!right && !comp(key, leaf->key)) return std::make_pair(leaf, false);
+
+        node *&next = right ? leaf->right : leaf->left;
+        if (next == NULL) {
+            next = new_node(key, value);
+            next->parent = leaf;
+            update_path(leaf);
+            return std::make_pair(next, true);
+        }
+        leaf = next;
+    }
+}
+
+/*
+Function Name: intersect
+Description:
+    Keeps only the keys that are also in another tree (set
+    intersection), in O(m log(n / m + 1)). Kept keys keep
+    this tree's node and value. other is left empty. Pass a
+    thread pool to split the work across it.
+Input(s):
+    other - tree reference. keys to keep. left empty.
+    pool - thread_pool pointer. NULL to run on this thread.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::intersect(btree& other, thread_pool *pool) {
+    set_operation(SET_INTERSECT, other, pool);
+}
+
+/*
+Function Name: join
+Description:
+    Moves every node of another tree onto the end of this
+    one in O(log n). Every key of right must be at or after
+    the largest key here. The two trees' node pools are
+    joined (node_pool::adopt) so the moved nodes can be
+    freed by this tree; right is left empty.
+Input(s):
+    right - tree reference. tree of larger keys.
+Return(s):
+    true - the trees were joined.
+    false - the key ranges overlap, nothing was moved.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+bool btree<Key, Value, Compare, Allocator>::join(btree& right) {
+    if ((&right == this) || (right.root == NULL)) return &right != this;
+    if ((root != NULL) && comp(right.min_node()->key, max_node()->key)) return false;
+
+    alloc.adopt(right.alloc);
+    set_root(join_trees(root, right.root));
+    count += right.count;
+    right.root = NULL;
+    right.count = 0;
+    return true;
+}
+
+/*
+Function Name: lower_bound
+Description:
+    Finds the first node whose key is not less than the
+    given key, in one walk down the tree.
+Input(s):
+    key - key reference. key to look for.
+Return(s):
+    iterator - first node with key >= key, end() if none.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::iterator
+btree<Key, Value, Compare, Allocator>::lower_bound(const Key& key) const {
+    node *leaf = root;
+    node *found = NULL;
+    while (leaf != NULL) {
+        if (comp(leaf->key, key)) {
+            leaf = leaf->right;
+        } else {
+            found = leaf;
+            leaf = leaf->left;
+        }
+    }
+    return iterator(found, &root);
+}
+
+/*
+Function Name: maxKey
+Description:
+    Finds the maximum key value in the binary tree.
+Input(s):
+    None
+Return(s):
+    max - key. maximum key value in tree, or the largest
+          possible key when the tree is empty.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+Key btree<Key, Value, Compare, Allocator>::maxKey() const {
+    if (root != NULL) return max_node()->key;
+    else return std::numeric_limits<Key>::max();
+}
+
+/*
+Function Name: max_node
+Description:
+    Finds the node with the maximum key by following right
+    children until the right child is NULL.
+Input(s):
+    None
+Return(s):
+    leaf - node pointer. node with the largest key.
+    NULL - tree is empty.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::node *
+btree<Key, Value, Compare, Allocator>::max_node() const {
+    node *leaf = root;
+    if (leaf == NULL) return NULL;
+    while (leaf->right != NULL) leaf = leaf->right;
+    return leaf;
+}
+
+/*
+Function Name: minKey
+Description:
+    Finds the minimum key value in the binary tree.
+Input(s):
+    None
+Return(s):
+    min - key. minimum key value in tree, or the smallest
+          possible key when the tree is empty.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+Key btree<Key, Value, Compare, Allocator>::minKey() const {
+    if (root != NULL) return min_node()->key;
+    else return std::numeric_limits<Key>::min();
+}
+
+/*
+Function Name: memory_usage
+Description:
+    Gets the bytes taken by the live nodes, for comparing
+    layouts (e.g. btree_multiset against one node per
+    duplicate). Pool slack and freed nodes are not counted.
+Input(s):
+    None
+Return(s):
+    bytes - size_t. size() * sizeof(node).
+*/
+template <class Key, class Value, class Compare, class Allocator>
+size_t btree<Key, Value, Compare, Allocator>::memory_usage() const {
+    return count * sizeof(node);
+}
+
+/*
+Function Name: merge
+Description:
+    Moves every node of another tree into this one (set
+    union), in O(m log(n / m + 1)) rather than one insert
+    per key. A key in both trees keeps this tree's node and
+    value. other is left empty. Pass a thread pool to split
+    the work across it.
+Input(s):
+    other - tree reference. keys to add. left empty.
+    pool - thread_pool pointer. NULL to run on this thread.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::merge(btree& other, thread_pool *pool) {
+    set_operation(SET_UNION, other, pool);
+}
+
+/*
+Function Name: min_node
+Description:
+    Finds the node with the minimum key by following left
+    children until the left child is NULL.
+Input(s):
+    None
+Return(s):
+    leaf - node pointer. node with the smallest key.
+    NULL - tree is empty.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::node *
+btree<Key, Value, Compare, Allocator>::min_node() const {
+    node *leaf = root;
+    if (leaf == NULL) return NULL;
+    while (leaf->left != NULL) leaf = leaf->left;
+    return leaf;
+}
+
+/*
+Function Name: parallel_for_each
+Description:
+    Calls visit(node) for every node, splitting the tree
+    into pieces of consecutive keys run across a thread
+    pool. Each piece is visited in ascending order, but
+    pieces run at the same time, so visit must be safe to
+    call from several threads. The tree must not change
+    while this runs.
+Input(s):
+    visit - callable. called with a const node reference.
+    pool - thread_pool pointer. NULL to run in order on
+           this thread.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+template <class Visit>
+void btree<Key, Value, Compare, Allocator>::parallel_for_each(Visit visit, thread_pool *pool) const {
+    walk_pieces([&](size_t, iterator it, size_t n) {
+        for (size_t i = 0; i < n; i++, ++it) visit(*it);
+    }, pool);
+}
+
+/*
+Function Name: parallel_reduce
+Description:
+    Folds every node into one result, in parallel across a
+    thread pool. Each piece of consecutive keys starts from
+    a copy of init and adds its nodes in ascending order;
+    the pieces are then combined left to right. The pieces
+    depend only on the tree size, so the result is the same
+    whatever the pool. init must leave a value unchanged
+    when combined with it (0 for sums, an empty histogram).
+    e.g. total cost: parallel_reduce(0.0, [](double& total,
+    const node& leaf) { total += leaf.value.job_cost; },
+    [](double& total, const double& part) { total += part; },
+    &pool).
+Input(s):
+    init - T. starting value of every piece and the result.
+    add - callable. add(T& acc, const node& leaf).
+    combine - callable. combine(T& into, const T& part).
+    pool - thread_pool pointer. NULL to run in order on
+           this thread.
+Return(s):
+    result - T. every piece combined in key order.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+template <class T, class Accumulate, class Combine>
+T btree<Key, Value, Compare, Allocator>::parallel_reduce(T init, Accumulate add, Combine combine, thread_pool *pool) const {
+    // deque rather than vector so a T of bool is one object per piece
+    std::deque<T> parts(piece_count(), init);
+    walk_pieces([&](size_t piece, iterator it, size_t n) {
+        T acc = init;
+        for (size_t i = 0; i < n; i++, ++it) add(acc, *it);
+        parts[piece] = std::move(acc);
+    }, pool);
+
+    T result = init;
+    for (size_t i = 0; i < parts.size(); i++) combine(result, parts[i]);
+    return result;
+}
+
+/*
+Function Name: rank
+Description:
+    Counts the keys less than the given key. The key does
+    not have to be in the tree.
+Input(s):
+    key - key reference. key to rank.
+Return(s):
+    rank - size_t. number of keys less than key.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+size_t btree<Key, Value, Compare, Allocator>::rank(const Key& key) const {
+    return rank(key, false);
+}
+
+/*
+Function Name: rbegin
+Description:
+    Gets a reverse iterator to the largest key.
+Input(s):
+    None
+Return(s):
+    reverse_iterator - first node in descending order.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::reverse_iterator
+btree<Key, Value, Compare, Allocator>::rbegin() const {
+    return reverse_iterator(end());
+}
+
+/*
+Function Name: reclaim
+Description:
+    Frees every node cut off by erase_range() that has not
+    been reused yet, e.g. from an idle moment rather than
+    on the next burst of inserts.
+Input(s):
+    None
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::reclaim() {
+    while (!detached.empty()) alloc.deallocate(take_detached());
+}
+
+/*
+Function Name: rend
+Description:
+    Gets the reverse iterator one past the smallest key.
+Input(s):
+    None
+Return(s):
+    reverse_iterator - past-the-end reverse iterator.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::reverse_iterator
+btree<Key, Value, Compare, Allocator>::rend() const {
+    return reverse_iterator(begin());
+}
+
+/*
+Function Name: search
+Description:
+    Searches the binary tree for a key and returns the node
+    with that key.
+
+    Keys with a cheap compare (see btree_fast_compare) take
+    a single compare per level, remembering the last node
+    that was not less than the key, and test that node for
+    equality once at the bottom. The branches reduce to
+    conditional moves. Other keys stop as soon as they hit
+    an equal node.
+Input(s):
+    key - key reference. value to look for in tree.
+Return(s):
+    leaf - node pointer. leaf with value.
+    NULL - value not found in tree.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::node *
+btree<Key, Value, Compare, Allocator>::search(const Key& key) const {
+    node *leaf = root;
+
+    if constexpr (btree_fast_compare<Key, Compare>::value) {
+        node *found = NULL;
+        while (leaf != NULL) {
+            bool right = comp(leaf->key, key);
+            found = right ? found : leaf;
+            leaf = right ? leaf->right : leaf->left;
+        }
+        if ((found != NULL) && !comp(key, found->key)) return found;
+        return NULL;
+    } else {
+        while (leaf != NULL) {
+            if (comp(key, leaf->key)) leaf = leaf->left;
+            else if (comp(leaf->key, key)) leaf = leaf->right;
+            else return leaf;
+        }
+        return NULL;
+    }
+}
+
+/*
+Function Name: select
+Description:
+    Finds the node holding the i-th smallest key (counting
+    from 0), steering by the left subtree sizes.
+    select(size() / 2) is the median.
+Input(s):
+    i - size_t. position of the key in ascending order.
+Return(s):
+    leaf - node pointer. node at that position.
+    NULL - i is not less than size().
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::node *
+btree<Key, Value, Compare, Allocator>::select(size_t i) const {
+    node *leaf = root;
+    while (leaf != NULL) {
+        size_t left = size(leaf->left);
+        if (i < left) {
+            leaf = leaf->left;
+        } else if (i == left) {
+            return leaf;
+        } else {
+            i -= left + 1;
+            leaf = leaf->right;
+        }
+    }
+    return NULL;
+}
+
+/*
+Function Name: size
+Description:
+    Gets the number of nodes in the tree.
+Input(s):
+    None
+Return(s):
+    count - size_t. number of nodes.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+size_t btree<Key, Value, Compare, Allocator>::size() const {
+    return count;
+}
+
+/*
+Function Name: split
+Description:
+    Moves every key at or after key into another tree in
+    O(log n), leaving the smaller keys here. Whatever right
+    held before is freed first. The two trees' node pools
+    are joined (node_pool::adopt) so either tree can free
+    the nodes it ends up with.
+Input(s):
+    key - key reference. first key to move.
+    right - tree reference. receives the larger keys.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare, class Allocator>
+void btree<Key, Value, Compare, Allocator>::split(const Key& key, btree& right) {
+    if (&right == this) return;
+
+    right.destroy_tree();
+    alloc.adopt(right.alloc);
+
+    node *left_part = NULL;
+    node *right_part = NULL;
+    split_nodes(root, key, false, left_part, right_part);
+    set_root(left_part);
+    right.set_root(right_part);
+    count = size(left_part);
+    right.count = size(right_part);
+}
+
+/*
+Function Name: upper_bound
+Description:
+    Finds the first node whose key is greater than the
+    given key, in one walk down the tree.
+Input(s):
+    key - key reference. key to look for.
+Return(s):
+    iterator - first node with key > key, end() if none.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+typename btree<Key, Value, Compare, Allocator>::iterator
+btree<Key, Value, Compare, Allocator>::upper_bound(const Key& key) const {
+    node *leaf = root;
+    node *found = NULL;
+    while (leaf != NULL) {
+        if (comp(key, leaf->key)) {
+            found = leaf;
+            leaf = leaf->left;
+        } else {
+            leaf = leaf->right;
+        }
+    }
+    return iterator(found, &root);
+}
+
+/*
+Function Name: validate
+Description:
+    Checks the whole tree with parallel_reduce(): parent
+    links, heights, subtree sizes, the AVL balance (for a
+    balanced tree) and the key order, at every node.
+Input(s):
+    pool - thread_pool pointer. NULL to run on this thread.
+Return(s):
+    true - the tree is sound.
+    false - something is broken.
+*/
+template <class Key, class Value, class Compare, class Allocator>
+bool btree<Key, Value, Compare, Allocator>::validate(thread_pool *pool) const {
+    if ((root != NULL) && (root->parent != NULL)) return false;
+    if (size(root) != count) return false;
+
+    piece_check init = {true, NULL, NULL};
+    piece_check result = parallel_reduce(init, [this](piece_check& acc, const node& leaf) {
+        int lh = height(leaf.left);
+        int rh = height(leaf.right);
+        bool ok = (leaf.height == std::max(lh, rh) + 1);
+        ok = ok && (leaf.size == size(leaf.left) + size(leaf.right) + 1);
+        ok = ok && ((leaf.left == NULL) || (leaf.left->parent == &leaf));
+        ok = ok && ((leaf.right == NULL) || (leaf.right->parent == &leaf));
+        ok = ok && (!balanced || ((lh - rh <= 1) && (rh - lh <= 1)));
+        ok = ok && ((acc.last == NULL) || !comp(leaf.key, acc.last->key));
+        if (acc.first == NULL) acc.first = &leaf;
+        acc.last = &leaf;
+        acc.ok = acc.ok && ok;
+    }, [this](piece_check& into, const piece_check& part) {
+        if (part.first == NULL) return;
+        if ((into.last != NULL) && comp(part.first->key, into.last->key)) into.ok = false;
+        if (into.first == NULL) into.first = part.first;
+        into.last = part.last;
+        into.ok = into.ok && part.ok;
+    }, pool);
+    return result.ok;
+}
+
+// --------- END Class Functions --------------
+
+#endif
@@ -0,0 +1,338 @@
+/*
+    Created By: Thomas Osgood
+
+    Description:
+        Multiset built on the generic btree. btree::insert()
+        gives every duplicate key a node of its own, so a
+        heavily repeated key costs a node per copy and
+        lengthens the tree. btree_multiset keeps one node per
+        distinct key with an occurrence count, and every node
+        also sums the counts of its subtree, so size() and
+        count_range() count occurrences in O(log n).
+
+        The btree base is protected, so keys only go in and
+        out through the btree_multiset functions (insert,
+        erase_one, erase_all, split, join), which keep the
+        counts right. rank(), select() and the iterators
+        work on distinct keys; it->value.count is the number
+        of copies of it->key.
+
+    To Use:
+    #include "btree_multiset.h"
+    btree_multiset<int> readings;
+    readings.insert(42);
+*/
+#ifndef BTREE_MULTISET_H
+#define BTREE_MULTISET_H
+
+// ------- REQUIRED Includes -------
+#include <cstddef>
+#include <functional>
+#include <iostream>
+
+#include "btree.h"
+
+/*
+    Create Structure For Occurrence Count
+
+    Mapped value of a btree_multiset node.
+*/
+struct btree_occurrences {
+    size_t count;
+};
+
+/*
+    Subtree summary of a multiset: total occurrences.
+*/
+template <class Key>
+struct btree_summary<Key, btree_occurrences> {
+    typedef size_t type;
+
+    static type of(const Key&, const btree_occurrences& value) { return value.count; }
+    static void merge(type& into, const type& other) { into += other; }
+};
+
+/*
+    Define Binary Tree Multiset Class
+*/
+template <class Key, class Compare = std::less<Key>, class Allocator = node_pool<Key> >
+class btree_multiset : protected btree<Key, btree_occurrences, Compare, Allocator> {
+    public:
+        typedef btree<Key, btree_occurrences, Compare, Allocator> base;
+        typedef typename base::node node;
+        typedef typename base::iterator iterator;
+        typedef typename base::reverse_iterator reverse_iterator;
+
+        // Read-only part of the btree; counts only change through btree_multiset
+        using base::begin;
+        using base::destroy_tree;
+        using base::empty;
+        using base::end;
+        using base::height;
+        using base::lower_bound;
+        using base::max_node;
+        using base::memory_usage;
+        using base::min_node;
+        using base::rank;
+        using base::rbegin;
+        using base::reclaim;
+        using base::rend;
+        using base::search;
+        using base::select;
+        using base::upper_bound;
+        using base::validate;
+
+        btree_multiset(bool balance = true, const Allocator& allocator = Allocator());
+
+        size_t count_range(const Key& lo, const Key& hi) const;
+        void display_tree();
+        void display_tree_rev();
+        size_t distinct() const;
+        size_t erase_all(const Key& key);
+        bool erase_one(const Key& key);
+        size_t insert(const Key& key, size_t copies = 1);
+        bool join(btree_multiset& right);
+        size_t occurrences(const Key& key) const;
+        size_t size() const;
+        void split(const Key& key, btree_multiset& right);
+};
+
+// --------- BEGIN Class Functions --------------
+
+/*
+Function Name: btree_multiset
+Description:
+    Multiset function that will be called when the tree
+    is allocated/created.
+Input(s):
+    balance - bool. keep the tree AVL balanced on insert
+              and delete. pass false for the plain tree.
+    allocator - allocator reference. where nodes come from.
+Return(s):
+    None
+*/
+template <class Key, class Compare, class Allocator>
+btree_multiset<Key, Compare, Allocator>::btree_multiset(bool balance, const Allocator& allocator) : base(balance, allocator) {
+}
+
+// --------- PUBLIC Class Functions --------------
+
+/*
+Function Name: count_range
+Description:
+    Counts the occurrences of keys from lo through hi
+    (inclusive) in O(log n), from the subtree summaries.
+Input(s):
+    lo - key reference. smallest key to count.
+    hi - key reference. largest key to count.
+Return(s):
+    count - size_t. occurrences in the range.
+*/
+template <class Key, class Compare, class Allocator>
+size_t btree_multiset<Key, Compare, Allocator>::count_range(const Key& lo, const Key& hi) const {
+    return this->aggregate(lo, hi);
+}
+
+/*
+Function Name: display_tree
+Description:
+    Displays the multiset from low to high, one line per
+    distinct key with its count when above one, or prints
+    a message telling the user that the tree is empty.
+Input(s):
+    None
+Return(s):
+    None
+*/
+template <class Key, class Compare, class Allocator>
+void btree_multiset<Key, Compare, Allocator>::display_tree() {
+    if (this->empty()) {
+        std::cout << "Tree Is Empty. Nothing To Display" << std::endl;
+        return;
+    }
+    for (iterator it = this->begin(); it != this->end(); ++it) {
+        std::cout << it->key;
+        if (it->value.count > 1) std::cout << " x" << it->value.count;
+        std::cout << '\n';
+    }
+    std::cout.flush();
+}
+
+/*
+Function Name: display_tree_rev
+Description:
+    Displays the multiset from high to low, one line per
+    distinct key with its count when above one, or prints
+    a message telling the user that the tree is empty.
+Input(s):
+    None
+Return(s):
+    None
+*/
+template <class Key, class Compare, class Allocator>
+void btree_multiset<Key, Compare, Allocator>::display_tree_rev() {
+    if (this->empty()) {
+        std::cout << "Tree Is Empty. Nothing To Display" << std::endl;
+        return;
+    }
+    for (typename base::reverse_iterator it = this->rbegin(); it != this->rend(); ++it) {
+        std::cout << it->key;
+        if (it->value.count > 1) std::cout << " x" << it->value.count;
+        std::cout << '\n';
+    }
+    std::cout.flush();
+}
+
+/*
+Function Name: distinct
+Description:
+    Gets the number of distinct keys, which is the number
+    of nodes.
+Input(s):
+    None
+Return(s):
+    count - size_t. distinct keys.
+*/
+template <class Key, class Compare, class Allocator>
+size_t btree_multiset<Key, Compare, Allocator>::distinct() const {
+    return base::size();
+}
+
+/*
+Function Name: erase_all
+Description:
+    Removes every occurrence of a key (its whole node).
+Input(s):
+    key - key reference. key to remove.
+Return(s):
+    removed - size_t. occurrences removed, 0 if the key
+              was not there.
+*/
+template <class Key, class Compare, class Allocator>
+size_t btree_multiset<Key, Compare, Allocator>::erase_all(const Key& key) {
+    node *leaf = this->search(key);
+    if (leaf == NULL) return 0;
+    size_t removed = leaf->value.count;
+    this->erase_node(leaf);
+    return removed;
+}
+
+/*
+Function Name: erase_one
+Description:
+    Removes one occurrence of a key. The node goes away
+    with the last one.
+Input(s):
+    key - key reference. key to remove one copy of.
+Return(s):
+    true - a copy was removed.
+    false - the key was not there.
+*/
+template <class Key, class Compare, class Allocator>
+bool btree_multiset<Key, Compare, Allocator>::erase_one(const Key& key) {
+    node *leaf = this->search(key);
+    if (leaf == NULL) return false;
+    if (leaf->value.count > 1) {
+        leaf->value.count--;
+        this->update_path(leaf);
+    } else {
+        this->erase_node(leaf);
+    }
+    return true;
+}
+
+/*
+Function Name: insert
+Description:
+    Adds copies of a key. A key already there only has its
+    count raised (and the counts above it refreshed); no
+    node is added.
+Input(s):
+    key - key reference. key to add.
+    copies - size_t. copies to add. defaults to 1
+Return(s):
+    count - size_t. occurrences of the key afterwards.
+*/
+template <class Key, class Compare, class Allocator>
+size_t btree_multiset<Key, Compare, Allocator>::insert(const Key& key, size_t copies) {
+    if (copies == 0) return occurrences(key);
+
+    node *leaf = this->search(key);
+    if (leaf != NULL) {
+        leaf->value.count += copies;
+        this->update_path(leaf);
+        return leaf->value.count;
+    }
+
+    btree_occurrences value = {copies};
+    return this->insert_unique(key, value).first->value.count;
+}
+
+/*
+Function Name: join
+Description:
+    Moves every key of another multiset, with its count,
+    onto the end of this one in O(log n) (see btree::join).
+    Every key of right must be at or after the largest key
+    here; right is left empty.
+Input(s):
+    right - multiset reference. multiset of larger keys.
+Return(s):
+    true - the multisets were joined.
+    false - the key ranges overlap, nothing was moved.
+*/
+template <class Key, class Compare, class Allocator>
+bool btree_multiset<Key, Compare, Allocator>::join(btree_multiset& right) {
+    return base::join(right);
+}
+
+/*
+Function Name: occurrences
+Description:
+    Counts the copies of a key.
+Input(s):
+    key - key reference. key to count.
+Return(s):
+    count - size_t. occurrences, 0 if the key is not there.
+*/
+template <class Key, class Compare, class Allocator>
+size_t btree_multiset<Key, Compare, Allocator>::occurrences(const Key& key) const {
+    const node *leaf = this->search(key);
+    return (leaf != NULL) ? leaf->value.count : 0;
+}
+
+/*
+Function Name: size
+Description:
+    Gets the total number of occurrences.
+Input(s):
+    None
+Return(s):
+    count - size_t. occurrences of every key.
+*/
+template <class Key, class Compare, class Allocator>
+size_t btree_multiset<Key, Compare, Allocator>::size() const {
+    return this->empty() ? 0 : this->root->summary;
+}
+
+/*
+Function Name: split
+Description:
+    Moves every key at or after key, with its count, into
+    another multiset in O(log n), leaving the smaller keys
+    here (see btree::split). Whatever right held before is
+    freed first.
+Input(s):
+    key - key reference. first key to move.
+    right - multiset reference. receives the larger keys.
+Return(s):
+    None
+*/
+template <class Key, class Compare, class Allocator>
+void btree_multiset<Key, Compare, Allocator>::split(const Key& key, btree_multiset& right) {
+    base::split(key, right);
+}
+
+// --------- END Class Functions --------------
+
+#endif
@@ -0,0 +1,691 @@
+/*
+    Created By: Thomas Osgood
+
+    Description:
+        Compact AVL tree whose nodes live in contiguous vectors
+        and link to each other with 32-bit indices instead of
+        8-byte pointers.
+
+        Each node is split three ways, by index:
+            links   - key plus left/right index. The only part a
+                      search touches, so more of them fit in
+                      each cache line.
+            heights - one byte of AVL height, read only while
+                      rebalancing.
+            values  - the mapped value (e.g. job cost and
+                      estimate), read only once a key is found.
+                      Not stored at all for an empty Value.
+        A btree<int> node is 48 bytes and a job_tree node 88;
+        here they are 13 and 25. Up to 2^32 - 1 nodes fit.
+        Erased slots are reused by later inserts.
+
+        Keys are unique; insert() of a key already there does
+        nothing. There are no parent links, so insert and erase
+        recurse down and rebalance on the way back up.
+
+    To Use:
+    #include "compact_btree.h"
+    compact_btree<job_key, job_data, job_key_less> jobs;
+*/
+#ifndef COMPACT_BTREE_H
+#define COMPACT_BTREE_H
+
+// ------- REQUIRED Includes -------
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+
+#include "btree.h"
+
+/*
+    Define Compact Binary Tree Class
+*/
+template <class Key, class Value = btree_empty, class Compare = std::less<Key> >
+class compact_btree {
+    public:
+        typedef uint32_t index_type;
+
+        static const index_type nil = 0xFFFFFFFFu; // no node; also the node limit
+
+        compact_btree(); // compact tree initializer
+
+        void destroy_tree();
+        void display_tree() const;
+        void display_tree_rev() const;
+        bool empty() const;
+        bool erase(const Key& key);
+        template <class Visit>
+        size_t for_each(Visit visit) const;
+        int height() const;
+        bool insert(const Key& key, const Value& value = Value());
+        Key maxKey() const;
+        size_t memory_usage() const;
+        Key minKey() const;
+        void reserve(size_t nodes);
+        Value *search(const Key& key);
+        const Value *search(const Key& key) const;
+        size_t size() const;
+
+    private:
+        /*
+            Hot half of a node: everything a search reads.
+        */
+        struct link_node {
+            Key key;
+            index_type left; // nil for none
+            index_type right; // nil for none; next free slot once freed
+        };
+
+        static const bool stores_values = !std::is_empty<Value>::value;
+
+        index_type erase(index_type leaf, const Key& key, bool& found);
+        index_type erase_min(index_type leaf, index_type& min);
+        index_type find(const Key& key) const;
+        void free_node(index_type leaf);
+        int height(index_type leaf) const;
+        index_type insert(index_type leaf, const Key& key, const Value& value, bool& inserted);
+        index_type new_node(const Key& key, const Value& value);
+        index_type rebalance(index_type leaf);
+        index_type rotate_left(index_type leaf);
+        index_type rotate_right(index_type leaf);
+        void update_node(index_type leaf);
+
+        Compare comp;
+        size_t count;
+        index_type free_list; // first reusable slot, nil if none
+        std::vector<unsigned char> heights;
+        std::vector<link_node> links;
+        index_type root;
+        Value shared_value; // what search() returns when values are not stored
+        std::vector<Value> values;
+};
+
+// --------- BEGIN Class Functions --------------
+
+/*
+Function Name: compact_btree
+Description:
+    Compact tree function that will be called when the
+    tree is allocated/created.
+Input(s):
+    None
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+compact_btree<Key, Value, Compare>::compact_btree() : count(0), free_list(nil), root(nil), shared_value() {
+}
+
+// --------- PRIVATE Class Functions --------------
+
+/*
+Function Name: erase
+Description:
+    Removes the node with the given key from a subtree and
+    rebalances on the way back up.
+Input(s):
+    leaf - index_type. current subtree root.
+    key - key reference. key to remove.
+    found - bool reference. set to true if the key was found.
+Return(s):
+    leaf - index_type. new root of this subtree.
+*/
+template <class Key, class Value, class Compare>
+typename compact_btree<Key, Value, Compare>::index_type
+compact_btree<Key, Value, Compare>::erase(index_type leaf, const Key& key, bool& found) {
+    if (leaf == nil) return nil;
+
+    if (comp(key, links[leaf].key)) {
+        index_type left = erase(links[leaf].left, key, found);
+        if (!found) return leaf;
+        links[leaf].left = left;
+    } else if (comp(links[leaf].key, key)) {
+        index_type right = erase(links[leaf].right, key, found);
+        if (!found) return leaf;
+        links[leaf].right = right;
+    } else {
+        found = true;
+        index_type left = links[leaf].left;
+        index_type right = links[leaf].right;
+        free_node(leaf);
+        if (left == nil) return right;
+        if (right == nil) return left;
+
+        // ------ Two Children: Successor Takes Its Place ------
+        index_type min = nil;
+        right = erase_min(right, min);
+        links[min].left = left;
+        links[min].right = right;
+        leaf = min;
+    }
+    return rebalance(leaf);
+}
+
+/*
+Function Name: erase_min
+Description:
+    Unlinks the smallest node of a subtree.
+Input(s):
+    leaf - index_type. current subtree root.
+    min - index_type reference. receives the unlinked node.
+Return(s):
+    leaf - index_type. new root of this subtree.
+*/
+template <class Key, class Value, class Compare>
+typename compact_btree<Key, Value, Compare>::index_type
+compact_btree<Key, Value, Compare>::erase_min(index_type leaf, index_type& min) {
+    if (links[leaf].left == nil) {
+        min = leaf;
+        return links[leaf].right;
+    }
+    links[leaf].left = erase_min(links[leaf].left, min);
+    return rebalance(leaf);
+}
+
+/*
+Function Name: find
+Description:
+    Searches the tree for a key, reading only the links.
+Input(s):
+    key - key reference. key to look for.
+Return(s):
+    leaf - index_type. node holding the key, nil if none.
+*/
+template <class Key, class Value, class Compare>
+typename compact_btree<Key, Value, Compare>::index_type
+compact_btree<Key, Value, Compare>::find(const Key& key) const {
+    index_type leaf = root;
+    while (leaf != nil) {
+        const link_node& at = links[leaf];
+        if (comp(key, at.key)) leaf = at.left;
+        else if (comp(at.key, key)) leaf = at.right;
+        else return leaf;
+    }
+    return nil;
+}
+
+/*
+Function Name: free_node
+Description:
+    Puts a node's slot on the free list for reuse.
+Input(s):
+    leaf - index_type. node to free.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+void compact_btree<Key, Value, Compare>::free_node(index_type leaf) {
+    links[leaf].left = nil;
+    links[leaf].right = free_list;
+    if constexpr (stores_values) values[leaf] = Value();
+    free_list = leaf;
+    count--;
+}
+
+/*
+Function Name: height
+Description:
+    Gets the height of a subtree.
+Input(s):
+    leaf - index_type. root of the subtree.
+Return(s):
+    height - integer. 0 for an empty subtree.
+*/
+template <class Key, class Value, class Compare>
+int compact_btree<Key, Value, Compare>::height(index_type leaf) const {
+    if (leaf != nil) return heights[leaf];
+    else return 0;
+}
+
+/*
+Function Name: insert
+Description:
+    Inserts a key into a subtree and rebalances on the way
+    back up. Nothing changes when the key is already there.
+Input(s):
+    leaf - index_type. current subtree root.
+    key - key reference. key to insert.
+    value - value reference. mapped value for the key.
+    inserted - bool reference. set to true if a node was added.
+Return(s):
+    leaf - index_type. new root of this subtree.
+*/
+template <class Key, class Value, class Compare>
+typename compact_btree<Key, Value, Compare>::index_type
+compact_btree<Key, Value, Compare>::insert(index_type leaf, const Key& key, const Value& value, bool& inserted) {
+    if (leaf == nil) {
+        inserted = true;
+        return new_node(key, value);
+    }
+
+    // new_node() may move the vectors, so no references are held across it
+    if (comp(key, links[leaf].key)) {
+        index_type left = insert(links[leaf].left, key, value, inserted);
+        if (!inserted) return leaf;
+        links[leaf].left = left;
+    } else if (comp(links[leaf].key, key)) {
+        index_type right = insert(links[leaf].right, key, value, inserted);
+        if (!inserted) return leaf;
+        links[leaf].right = right;
+    } else {
+        return leaf;
+    }
+    return rebalance(leaf);
+}
+
+/*
+Function Name: new_node
+Description:
+    Takes a slot off the free list, or adds one at the end.
+Input(s):
+    key - key reference. key for the new node.
+    value - value reference. mapped value for the new node.
+Return(s):
+    leaf - index_type. the new node.
+*/
+template <class Key, class Value, class Compare>
+typename compact_btree<Key, Value, Compare>::index_type
+compact_btree<Key, Value, Compare>::new_node(const Key& key, const Value& value) {
+    link_node fresh = {key, nil, nil};
+    index_type leaf = free_list;
+    if (leaf != nil) {
+        free_list = links[leaf].right;
+        links[leaf] = fresh;
+        heights[leaf] = 1;
+        if constexpr (stores_values) values[leaf] = value;
+    } else {
+        leaf = (index_type)links.size();
+        links.push_back(fresh);
+        heights.push_back(1);
+        if constexpr (stores_values) values.push_back(value);
+    }
+    count++;
+    return leaf;
+}
+
+/*
+Function Name: rebalance
+Description:
+    Restores the AVL property at a node after one of its
+    subtrees changed.
+Input(s):
+    leaf - index_type. node to rebalance.
+Return(s):
+    leaf - index_type. new root of this subtree.
+*/
+template <class Key, class Value, class Compare>
+typename compact_btree<Key, Value, Compare>::index_type
+compact_btree<Key, Value, Compare>::rebalance(index_type leaf) {
+    update_node(leaf);
+
+    int balance = height(links[leaf].left) - height(links[leaf].right);
+    if (balance > 1) {
+        index_type left = links[leaf].left;
+        if (height(links[left].left) < height(links[left].right)) links[leaf].left = rotate_left(left);
+        return rotate_right(leaf);
+    } else if (balance < -1) {
+        index_type right = links[leaf].right;
+        if (height(links[right].right) < height(links[right].left)) links[leaf].right = rotate_right(right);
+        return rotate_left(leaf);
+    }
+    return leaf;
+}
+
+/*
+Function Name: rotate_left
+Description:
+    Rotates a subtree to the left; the right child becomes
+    the new subtree root.
+Input(s):
+    leaf - index_type. current subtree root.
+Return(s):
+    pivot - index_type. new subtree root.
+*/
+template <class Key, class Value, class Compare>
+typename compact_btree<Key, Value, Compare>::index_type
+compact_btree<Key, Value, Compare>::rotate_left(index_type leaf) {
+    index_type pivot = links[leaf].right;
+    links[leaf].right = links[pivot].left;
+    links[pivot].left = leaf;
+    update_node(leaf);
+    update_node(pivot);
+    return pivot;
+}
+
+/*
+Function Name: rotate_right
+Description:
+    Rotates a subtree to the right; the left child becomes
+    the new subtree root.
+Input(s):
+    leaf - index_type. current subtree root.
+Return(s):
+    pivot - index_type. new subtree root.
+*/
+template <class Key, class Value, class Compare>
+typename compact_btree<Key, Value, Compare>::index_type
+compact_btree<Key, Value, Compare>::rotate_right(index_type leaf) {
+    index_type pivot = links[leaf].left;
+    links[leaf].left = links[pivot].right;
+    links[pivot].right = leaf;
+    update_node(leaf);
+    update_node(pivot);
+    return pivot;
+}
+
+/*
+Function Name: update_node
+Description:
+    Recomputes the height of a node from its children.
+Input(s):
+    leaf - index_type. node to update.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+void compact_btree<Key, Value, Compare>::update_node(index_type leaf) {
+    int lh = height(links[leaf].left);
+    int rh = height(links[leaf].right);
+    heights[leaf] = (unsigned char)((lh > rh ? lh : rh) + 1);
+}
+
+// --------- PUBLIC Class Functions --------------
+
+/*
+Function Name: destroy_tree
+Description:
+    Removes every node and gives the vectors' memory back.
+Input(s):
+    None
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+void compact_btree<Key, Value, Compare>::destroy_tree() {
+    std::vector<link_node>().swap(links);
+    std::vector<unsigned char>().swap(heights);
+    std::vector<Value>().swap(values);
+    count = 0;
+    free_list = nil;
+    root = nil;
+}
+
+/*
+Function Name: display_tree
+Description:
+    Displays the tree from low to high, or prints a message
+    telling the user that the tree is empty.
+Input(s):
+    None
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+void compact_btree<Key, Value, Compare>::display_tree() const {
+    if (root == nil) {
+        std::cout << "Tree Is Empty. Nothing To Display" << std::endl;
+        return;
+    }
+    for_each([](const Key& key, const Value&) { std::cout << key << '\n'; });
+    std::cout.flush();
+}
+
+/*
+Function Name: display_tree_rev
+Description:
+    Displays the tree from high to low, or prints a message
+    telling the user that the tree is empty.
+Input(s):
+    None
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+void compact_btree<Key, Value, Compare>::display_tree_rev() const {
+    if (root == nil) {
+        std::cout << "Tree Is Empty. Nothing To Display" << std::endl;
+        return;
+    }
+    index_type stack[64];
+    int depth = 0;
+    index_type leaf = root;
+    while ((leaf != nil) || (depth > 0)) {
+        while (leaf != nil) {
+            stack[depth++] = leaf;
+            leaf = links[leaf].right;
+        }
+        leaf = stack[--depth];
+        std::cout << links[leaf].key << '\n';
+        leaf = links[leaf].left;
+    }
+    std::cout.flush();
+}
+
+/*
+Function Name: empty
+Description:
+    Checks whether the tree has no nodes.
+Input(s):
+    None
+Return(s):
+    true - the tree is empty.
+    false - the tree has at least one node.
+*/
+template <class Key, class Value, class Compare>
+bool compact_btree<Key, Value, Compare>::empty() const {
+    return count == 0;
+}
+
+/*
+Function Name: erase
+Description:
+    Removes a key from the tree. Its slot is reused by a
+    later insert.
+Input(s):
+    key - key reference. key to remove.
+Return(s):
+    true - the key was removed.
+    false - the key was not in the tree.
+*/
+template <class Key, class Value, class Compare>
+bool compact_btree<Key, Value, Compare>::erase(const Key& key) {
+    bool found = false;
+    root = erase(root, key, found);
+    return found;
+}
+
+/*
+Function Name: for_each
+Description:
+    Calls visit(key, value) for every node in ascending
+    order. Walks with a fixed stack of ancestors; an AVL
+    tree of 2^32 nodes is under 48 levels high.
+Input(s):
+    visit - callable. called with each key and value.
+Return(s):
+    visited - size_t. number of nodes visited.
+*/
+template <class Key, class Value, class Compare>
+template <class Visit>
+size_t compact_btree<Key, Value, Compare>::for_each(Visit visit) const {
+    index_type stack[64];
+    int depth = 0;
+    size_t visited = 0;
+
+    index_type leaf = root;
+    while ((leaf != nil) || (depth > 0)) {
+        while (leaf != nil) {
+            stack[depth++] = leaf;
+            leaf = links[leaf].left;
+        }
+        leaf = stack[--depth];
+        if constexpr (stores_values) visit(links[leaf].key, values[leaf]);
+        else visit(links[leaf].key, shared_value);
+        visited++;
+        leaf = links[leaf].right;
+    }
+    return visited;
+}
+
+/*
+Function Name: height
+Description:
+    Gets the height of the tree.
+Input(s):
+    None
+Return(s):
+    height - integer. 0 for an empty tree.
+*/
+template <class Key, class Value, class Compare>
+int compact_btree<Key, Value, Compare>::height() const {
+    return height(root);
+}
+
+/*
+Function Name: insert
+Description:
+    Inserts a key into the tree unless it is already there.
+Input(s):
+    key - key reference. key to insert.
+    value - value reference. mapped value for the key.
+Return(s):
+    true - the key was added.
+    false - the key was already there, or the tree already
+            holds 2^32 - 1 nodes.
+*/
+template <class Key, class Value, class Compare>
+bool compact_btree<Key, Value, Compare>::insert(const Key& key, const Value& value) {
+    if ((free_list == nil) && (links.size() >= (size_t)nil)) return false;
+
+    bool inserted = false;
+    root = insert(root, key, value, inserted);
+    return inserted;
+}
+
+/*
+Function Name: maxKey
+Description:
+    Gets the largest key in the tree.
+Input(s):
+    None
+Return(s):
+    key - largest key, or Key() if the tree is empty.
+*/
+template <class Key, class Value, class Compare>
+Key compact_btree<Key, Value, Compare>::maxKey() const {
+    if (root == nil) return Key();
+    index_type leaf = root;
+    while (links[leaf].right != nil) leaf = links[leaf].right;
+    return links[leaf].key;
+}
+
+/*
+Function Name: memory_usage
+Description:
+    Gets the bytes taken by the live nodes (links, height
+    and value), to compare with btree::memory_usage().
+    Vector slack and free slots are not counted.
+Input(s):
+    None
+Return(s):
+    bytes - size_t. bytes per node times size().
+*/
+template <class Key, class Value, class Compare>
+size_t compact_btree<Key, Value, Compare>::memory_usage() const {
+    size_t per_node = sizeof(link_node) + sizeof(unsigned char);
+    if (stores_values) per_node += sizeof(Value);
+    return count * per_node;
+}
+
+/*
+Function Name: minKey
+Description:
+    Gets the smallest key in the tree.
+Input(s):
+    None
+Return(s):
+    key - smallest key, or Key() if the tree is empty.
+*/
+template <class Key, class Value, class Compare>
+Key compact_btree<Key, Value, Compare>::minKey() const {
+    if (root == nil) return Key();
+    index_type leaf = root;
+    while (links[leaf].left != nil) leaf = links[leaf].left;
+    return links[leaf].key;
+}
+
+/*
+Function Name: reserve
+Description:
+    Makes room for a number of nodes up front so loading
+    them never moves the vectors.
+Input(s):
+    nodes - size_t. nodes to make room for.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+void compact_btree<Key, Value, Compare>::reserve(size_t nodes) {
+    links.reserve(nodes);
+    heights.reserve(nodes);
+    if (stores_values) values.reserve(nodes);
+}
+
+/*
+Function Name: search
+Description:
+    Searches the tree for a key.
+Input(s):
+    key - key reference. key to look for.
+Return(s):
+    value - Value pointer. the key's mapped value, valid
+            until the next insert or erase.
+    NULL - the key is not in the tree.
+*/
+template <class Key, class Value, class Compare>
+Value *compact_btree<Key, Value, Compare>::search(const Key& key) {
+    index_type leaf = find(key);
+    if (leaf == nil) return NULL;
+    if constexpr (stores_values) return &values[leaf];
+    else return &shared_value;
+}
+
+/*
+Function Name: search
+Description:
+    Searches the tree for a key.
+Input(s):
+    key - key reference. key to look for.
+Return(s):
+    value - const Value pointer. the key's mapped value,
+            valid until the next insert or erase.
+    NULL - the key is not in the tree.
+*/
+template <class Key, class Value, class Compare>
+const Value *compact_btree<Key, Value, Compare>::search(const Key& key) const {
+    index_type leaf = find(key);
+    if (leaf == nil) return NULL;
+    if constexpr (stores_values) return &values[leaf];
+    else return &shared_value;
+}
+
+/*
+Function Name: size
+Description:
+    Gets the number of nodes in the tree.
+Input(s):
+    None
+Return(s):
+    count - size_t. number of nodes.
+*/
+template <class Key, class Value, class Compare>
+size_t compact_btree<Key, Value, Compare>::size() const {
+    return count;
+}
+
+// --------- END Class Functions --------------
+
+#endif
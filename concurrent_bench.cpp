@@ -0,0 +1,320 @@
+/*
+    Created By: Thomas Osgood
+
+    Description:
+        Stress test and scaling benchmark for concurrent_btree.
+
+        1) Stress: writer threads insert and erase odd keys
+           while reader threads search, scan and read the
+           min/max of the tree. Even keys are loaded up front
+           and never removed, so every reader must always find
+           them, and every scan must come back in order. At the
+           end the tree must hold exactly what the writers
+           think it holds.
+        2) Scaling: lookups per second with 1, 2, 4, ... up to
+           the core count of reader threads, with one writer
+           changing the tree the whole time.
+
+        The job stress readers also take snapshots now and
+        then and total them twice, as a report would; both
+        passes must agree with each other and the snapshot
+        size no matter what the writer did in between.
+
+    Usage:
+    ./<binary_name> [keys] [seconds]
+
+    To Compile:
+    g++ -std=c++17 -O2 -pthread -o <binary_name> concurrent_bench.cpp
+*/
+
+// ------- REQUIRED Includes -------
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "concurrent_btree.h"
+#include "job_tree.h"
+
+typedef concurrent_btree<int, int> int_tree;
+typedef concurrent_btree<job_key, job_data, job_key_less> job_table;
+
+/*
+    Function Prototypes
+*/
+bool stress_ints(int keys, double seconds, int readers, int writers);
+bool stress_jobs(int keys, double seconds, int readers);
+void scale_reads(int keys, double seconds, int max_threads);
+
+/*
+    Main Function
+*/
+int main(int argc, char **argv) {
+    int keys = (argc > 1) ? std::atoi(argv[1]) : 100000;
+    double seconds = (argc > 2) ? std::atof(argv[2]) : 1.0;
+    if ((keys < 1) || !(seconds > 0)) {
+        std::cout << "Usage: " << argv[0] << " [keys >= 1] [seconds > 0]" << std::endl;
+        return 1;
+    }
+    int cores = (int)std::thread::hardware_concurrency();
+    if (cores < 1) cores = 1;
+
+    std::cout << "[+] " << keys << " keys, " << seconds << "s per run, " << cores << " cores" << std::endl;
+
+    // ------ Stress: Readers Never See A Broken Tree ------
+    bool ok = stress_ints(keys, seconds, (cores > 2) ? cores - 2 : 2, 2);
+    ok = stress_jobs(keys, seconds, (cores > 1) ? cores - 1 : 2) && ok;
+
+    // ------ Scaling: Lookups Per Second By Reader Count ------
+    scale_reads(keys, seconds, cores);
+
+    if (!ok) {
+        std::cout << "\033[31m[!] STRESS TEST FAILED\033[0m" << std::endl;
+        return 1;
+    }
+    std::cout << "[+] Stress test passed" << std::endl;
+    return 0;
+}
+
+/*
+    Sub Functions
+*/
+
+/*
+Function Name: stress_ints
+Description:
+    Runs writers that insert/erase odd keys against readers
+    that check the even keys, scan order and min/max.
+Input(s):
+    keys - int. size of the key space.
+    seconds - double. how long to run.
+    readers - int. number of reader threads.
+    writers - int. number of writer threads.
+Return(s):
+    true - no reader or final check saw a problem.
+*/
+bool stress_ints(int keys, double seconds, int readers, int writers) {
+    int_tree tree;
+    for (int k = 0; k < keys; k += 2) tree.insert(k, k);
+
+    std::atomic<bool> stop(false);
+    std::atomic<long> errors(0);
+    std::atomic<long> reads(0);
+    std::vector<std::set<int> > owned(writers);
+    std::vector<std::thread> threads;
+
+    // ------ Writers: Each Owns The Odd Keys k % writers == w ------
+    for (int w = 0; w < writers; w++) {
+        threads.push_back(std::thread([&, w]() {
+            std::mt19937 rng(w + 1);
+            std::set<int>& mine = owned[w];
+            while (!stop.load()) {
+                int k = (int)(rng() % (unsigned)keys) | 1;
+                if ((k / 2) % writers != w) continue;
+                if (rng() % 2) {
+                    if (tree.insert(k, k) != (mine.count(k) == 0)) errors++;
+                    mine.insert(k);
+                } else {
+                    if (tree.erase(k) != (mine.count(k) == 1)) errors++;
+                    mine.erase(k);
+                }
+            }
+        }));
+    }
+
+    // ------ Readers ------
+    for (int r = 0; r < readers; r++) {
+        threads.push_back(std::thread([&, r]() {
+            std::mt19937 rng(100 + r);
+            long n = 0;
+            while (!stop.load()) {
+                int k = (int)(rng() % (unsigned)keys) & ~1;
+                int value = -1;
+                if (!tree.search(k, value) || (value != k)) errors++;
+
+                if (n % 64 == 0) {
+                    int last = -1;
+                    int lo = (int)(rng() % (unsigned)keys);
+                    tree.scan(lo, lo + 256, [&](const int& key, const int& v) {
+                        if ((key <= last) || (v != key)) errors++;
+                        last = key;
+                    });
+
+                    int_tree::item_type low;
+                    int_tree::item_type high;
+                    if (!tree.min_item(low) || (low.first != 0)) errors++;
+                    if (!tree.max_item(high) || (high.first < keys - 2)) errors++;
+                }
+                n++;
+            }
+            reads += n;
+        }));
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop.store(true);
+    for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+
+    // ------ Final Contents Match What Writers Did ------
+    size_t expected = (keys + 1) / 2;
+    for (int w = 0; w < writers; w++) {
+        expected += owned[w].size();
+        for (std::set<int>::iterator it = owned[w].begin(); it != owned[w].end(); ++it) {
+            if (!tree.contains(*it)) errors++;
+        }
+    }
+    if (tree.size() != expected) errors++;
+
+    std::cout << "[*] int stress: " << readers << " readers, " << writers << " writers, ";
+    std::cout << reads.load() << " reads, " << tree.pending() << " nodes waiting, ";
+    std::cout << errors.load() << " errors" << std::endl;
+    return errors.load() == 0;
+}
+
+/*
+Function Name: stress_jobs
+Description:
+    Same idea as stress_ints with job keys: one writer adds
+    and removes jobs in year 2 while readers look up the
+    fixed jobs of year 1 and scan year 1 in order. Every
+    so often a reader snapshots the table and totals it
+    twice; the totals must match.
+Input(s):
+    keys - int. jobs per year.
+    seconds - double. how long to run.
+    readers - int. number of reader threads.
+Return(s):
+    true - no reader or final check saw a problem.
+*/
+bool stress_jobs(int keys, double seconds, int readers) {
+    job_table jobs;
+    for (int n = 0; n < keys; n++) {
+        job_key key = {1, (unsigned int)n};
+        job_data data = {(float)n, (float)n};
+        jobs.insert(key, data);
+    }
+
+    std::atomic<bool> stop(false);
+    std::atomic<long> errors(0);
+    std::set<unsigned int> mine;
+    std::vector<std::thread> threads;
+
+    threads.push_back(std::thread([&]() {
+        std::mt19937 rng(7);
+        while (!stop.load()) {
+            job_key key = {2, (unsigned int)(rng() % (unsigned)keys)};
+            job_data data = {0, 0};
+            if (rng() % 2) {
+                if (jobs.insert(key, data) != (mine.count(key.job_number()) == 0)) errors++;
+                mine.insert(key.job_number());
+            } else {
+                if (jobs.erase(key) != (mine.count(key.job_number()) == 1)) errors++;
+                mine.erase(key.job_number());
+            }
+        }
+    }));
+
+    for (int r = 0; r < readers; r++) {
+        threads.push_back(std::thread([&, r]() {
+            std::mt19937 rng(200 + r);
+            long n = 0;
+            while (!stop.load()) {
+                job_key key = {1, (unsigned int)(rng() % (unsigned)keys)};
+                job_data data;
+                if (!jobs.search(key, data) || (data.job_cost != (float)key.job_number())) errors++;
+
+                job_table::item_type oldest;
+                if (!jobs.min_item(oldest) || (oldest.first.year() != 1) || (oldest.first.job_number() != 0)) errors++;
+
+                job_key lo = {1, key.job_number()};
+                job_key hi = {1, key.job_number() + 32};
+                unsigned int last = key.job_number();
+                size_t seen = jobs.scan(lo, hi, [&](const job_key& k, const job_data&) {
+                    if (k.job_number() < last) errors++;
+                    last = k.job_number() + 1;
+                });
+                if (seen == 0) errors++;
+
+                if (n % 256 == 0) {
+                    job_table::version report = jobs.snapshot();
+                    double totals[2] = {0, 0};
+                    size_t counted[2];
+                    for (int pass = 0; pass < 2; pass++) {
+                        counted[pass] = report.for_each([&](const job_key&, const job_data& data) { totals[pass] += data.job_cost; });
+                    }
+                    if ((totals[0] != totals[1]) || (counted[0] != counted[1]) || (counted[0] != report.size())) errors++;
+                }
+                n++;
+            }
+        }));
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop.store(true);
+    for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+
+    if (jobs.size() != (size_t)keys + mine.size()) errors++;
+
+    std::cout << "[*] job stress: " << readers << " readers, 1 writer, ";
+    std::cout << jobs.pending() << " nodes waiting, " << errors.load() << " errors" << std::endl;
+    return errors.load() == 0;
+}
+
+/*
+Function Name: scale_reads
+Description:
+    Measures lookups per second for a growing number of
+    reader threads while one writer keeps changing the tree.
+Input(s):
+    keys - int. number of keys in the tree.
+    seconds - double. how long each run lasts.
+    max_threads - int. largest reader count to try.
+Return(s):
+    None
+*/
+void scale_reads(int keys, double seconds, int max_threads) {
+    int_tree tree;
+    for (int k = 0; k < keys; k++) tree.insert(k, k);
+
+    std::cout << "readers\tlookups/sec\tper reader" << std::endl;
+    for (int readers = 1; ; readers *= 2) {
+        if (readers > max_threads) readers = max_threads;
+
+        std::atomic<bool> stop(false);
+        std::atomic<long> total(0);
+        std::vector<std::thread> threads;
+
+        threads.push_back(std::thread([&]() {
+            std::mt19937 rng(1);
+            while (!stop.load()) {
+                int k = (int)(rng() % (unsigned)keys);
+                tree.erase(k);
+                tree.insert(k, k);
+            }
+        }));
+        for (int r = 0; r < readers; r++) {
+            threads.push_back(std::thread([&, r]() {
+                std::mt19937 rng(300 + r);
+                long n = 0;
+                int value = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    tree.search((int)(rng() % (unsigned)keys), value);
+                    n++;
+                }
+                total += n;
+            }));
+        }
+
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        stop.store(true);
+        for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+
+        double rate = total.load() / seconds;
+        std::cout << readers << "\t" << (long)rate << "\t" << (long)(rate / readers) << std::endl;
+        if (readers == max_threads) break;
+    }
+}
@@ -0,0 +1,1313 @@
+/*
+    Created By: Thomas Osgood
+
+    Description:
+        Binary search tree that many threads can read while
+        other threads write to it.
+
+        Readers never take a lock. Writers take turns on a
+        mutex and never change a node a reader can see:
+        every node on the changed path is copied, and the
+        new root is published with one atomic store. Nodes
+        that drop out of the tree are retired and only
+        freed once every reader that could still be looking
+        at them has finished (epoch based reclamation).
+
+        snapshot() pins the current version in O(1) and hands
+        back a reference counted, read-only view of it that
+        can be scanned at leisure while writers go on. A
+        replaced node is kept only while some pinned version
+        still contains it (born at or before the version,
+        replaced after it), so every write still costs
+        O(log n) nodes, and nodes are freed on the next write
+        once the last view that needs them is dropped.
+        A view's parallel_for_each() and parallel_reduce() cut
+        it into whole subtrees and run them on a thread_pool.
+
+    To Use:
+    #include "concurrent_btree.h"
+*/
+#ifndef CONCURRENT_BTREE_H
+#define CONCURRENT_BTREE_H
+
+// ------- REQUIRED Includes -------
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "btree.h"
+
+/*
+    Create Structure For Concurrent Node Object
+
+    Once a node is published it is never changed again.
+    birth is the write that created it; that write may
+    still change it in place before publishing.
+*/
+template <class Key, class Value>
+struct concurrent_node {
+    concurrent_node(const Key& k, const Value& v, uint64_t b) : key(k), value(v), height(1), birth(b), left(NULL), right(NULL) {}
+
+    Key key;
+    Value value;
+    int height;
+    uint64_t birth;
+    concurrent_node *left;
+    concurrent_node *right;
+};
+
+/*
+    Create Structure For Reader Slot
+
+    One cache line per slot so readers on different cores
+    do not share a line. Holds 0 while free, otherwise the
+    epoch the reader entered in.
+*/
+struct alignas(64) concurrent_reader_slot {
+    std::atomic<uint64_t> epoch;
+};
+
+/*
+    Define Concurrent Binary Tree Class
+*/
+template <class Key, class Value = btree_empty, class Compare = std::less<Key> >
+class concurrent_btree {
+    public:
+        typedef concurrent_node<Key, Value> node;
+        typedef std::pair<Key, Value> item_type;
+        class version;
+
+        static const size_t reader_slots = 256;
+
+        concurrent_btree(); // concurrent tree initializer
+        ~concurrent_btree(); // concurrent tree destroyer
+
+        // ------ Readers (lock-free) ------
+        bool contains(const Key& key) const;
+        bool max_item(item_type& item) const;
+        bool min_item(item_type& item) const;
+        template <class Visit>
+        size_t scan(const Key& lo, const Key& hi, Visit visit) const;
+        bool search(const Key& key, Value& value) const;
+        size_t size() const;
+        version snapshot() const;
+
+        // ------ Writers (serialized) ------
+        bool erase(const Key& key);
+        bool insert(const Key& key, const Value& value = Value());
+        size_t pending() const;
+
+    private:
+        concurrent_btree(const concurrent_btree&);
+        concurrent_btree& operator=(const concurrent_btree&);
+
+        /*
+            Pin: one pinned version, shared by every copy of
+            its view. Unpins the version when the last copy
+            goes away.
+        */
+        struct pin {
+            pin(const concurrent_btree *t, const node *r, size_t c, uint64_t s);
+            ~pin();
+
+            const concurrent_btree *tree;
+            const node *root;
+            size_t count;
+            uint64_t seq; // last write the version includes
+        };
+
+        /*
+            Reader Guard: announces the reader's epoch for as
+            long as it is in scope.
+        */
+        class read_guard {
+            public:
+                read_guard(const concurrent_btree& tree);
+                ~read_guard();
+
+            private:
+                concurrent_reader_slot *slot;
+        };
+
+        struct retired_batch {
+            uint64_t epoch;
+            uint64_t seq; // write that replaced the nodes
+            std::vector<node *> nodes;
+        };
+
+        struct held_node {
+            node *leaf;
+            uint64_t seq; // write that replaced the node
+        };
+
+        static bool edge_item(const node *leaf, bool largest, item_type& item);
+        node *erase(node *leaf, const Key& key, bool& found);
+        node *erase_min(node *leaf, node *&min);
+        const node *find(const node *leaf, const Key& key) const;
+        void free_node(node *leaf);
+        static int height(const node *leaf);
+        node *insert(node *leaf, const Key& key, const Value& value, bool& inserted);
+        node *new_node(const Key& key, const Value& value);
+        node *own(node *leaf);
+        bool pinned(const node *leaf, uint64_t seq) const;
+        void publish(node *leaf);
+        void reclaim();
+        node *rebalance(node *leaf);
+        node *rotate_left(node *leaf);
+        node *rotate_right(node *leaf);
+        void unpin(uint64_t seq) const;
+        static void update_node(node *leaf);
+        template <class Visit>
+        size_t walk(const node *leaf, const Key *lo, const Key *hi, Visit visit) const;
+
+        Compare comp;
+        std::atomic<node *> root;
+        std::atomic<size_t> count;
+
+        // ------ Epoch Reclamation ------
+        std::atomic<uint64_t> global_epoch;
+        mutable concurrent_reader_slot slots[reader_slots];
+
+        // ------ Writer State (guarded by writer_lock) ------
+        mutable std::mutex writer_lock;
+        uint64_t write_seq; // birth stamp of the current write
+        node_pool<node> pool;
+        std::vector<node *> replaced; // nodes unlinked by the current write
+        std::vector<retired_batch> retired;
+        std::vector<held_node> held; // past every reader, still in a pinned version
+
+        // ------ Pinned Versions (guarded by pin_lock) ------
+        mutable std::mutex pin_lock;
+        mutable std::multiset<uint64_t> pins;
+        mutable bool unpinned; // a pin went away since held was last checked
+};
+
+/*
+    Define Concurrent Binary Tree Version Class
+
+    Read-only view of one version of a concurrent_btree,
+    from concurrent_btree::snapshot(). Copies share the same
+    pinned version; it stays readable, unchanged by later
+    writes, until the last copy is destroyed. Reads take no
+    lock and no reader slot. Every view must be dropped
+    before its tree is destroyed.
+*/
+template <class Key, class Value, class Compare>
+class concurrent_btree<Key, Value, Compare>::version {
+    public:
+        version();
+
+        bool contains(const Key& key) const;
+        bool empty() const;
+        template <class Visit>
+        size_t for_each(Visit visit) const;
+        bool max_item(item_type& item) const;
+        bool min_item(item_type& item) const;
+        template <class Visit>
+        void parallel_for_each(Visit visit, thread_pool *pool = NULL) const;
+        template <class T, class Accumulate, class Combine>
+        T parallel_reduce(T init, Accumulate add, Combine combine, thread_pool *pool = NULL) const;
+        template <class Visit>
+        size_t scan(const Key& lo, const Key& hi, Visit visit) const;
+        bool search(const Key& key, Value& value) const;
+        size_t size() const;
+
+    private:
+        friend class concurrent_btree;
+        version(const std::shared_ptr<const pin>& p);
+
+        static void cut(const node *leaf, int depth, std::vector<const node *>& subtrees, std::vector<const node *>& between);
+        void cut_pieces(std::vector<const node *>& subtrees, std::vector<const node *>& between) const;
+
+        static const int piece_height = 12; // pieces are subtrees about this high
+        static const int most_cuts = 10; // at most 2^10 pieces
+
+        std::shared_ptr<const pin> state; // NULL for an empty view
+};
+
+// --------- BEGIN Reader Guard Functions --------------
+
+/*
+Function Name: read_guard
+Description:
+    Enters a read. Claims a free reader slot (starting from
+    one picked by the thread id, so a thread keeps hitting
+    its own cache line) and stores the current epoch in it.
+    The claim is a sequentially consistent exchange, so any
+    root loaded afterwards is at least as new as the epoch.
+Input(s):
+    tree - concurrent_btree reference. tree being read.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+concurrent_btree<Key, Value, Compare>::read_guard::read_guard(const concurrent_btree& tree) {
+    size_t i = std::hash<std::thread::id>()(std::this_thread::get_id()) % reader_slots;
+    while (true) {
+        uint64_t epoch = tree.global_epoch.load(std::memory_order_seq_cst);
+        uint64_t expected = 0;
+        slot = &tree.slots[i];
+        if (slot->epoch.compare_exchange_strong(expected, epoch, std::memory_order_seq_cst)) return;
+        i = (i + 1) % reader_slots;
+    }
+}
+
+/*
+Function Name: ~read_guard
+Description:
+    Leaves a read by freeing the reader slot.
+Input(s):
+    None
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+concurrent_btree<Key, Value, Compare>::read_guard::~read_guard() {
+    slot->epoch.store(0, std::memory_order_release);
+}
+
+// --------- END Reader Guard Functions --------------
+
+// --------- BEGIN Version Functions --------------
+
+/*
+Function Name: pin
+Description:
+    Pins a version of a tree. Called by snapshot() with the
+    writer lock held, so no write can slip in between.
+Input(s):
+    t - concurrent_btree pointer. tree the version is of.
+    r - node pointer. root of the version.
+    c - size_t. number of keys in the version.
+    s - uint64_t. last write the version includes.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+concurrent_btree<Key, Value, Compare>::pin::pin(const concurrent_btree *t, const node *r, size_t c, uint64_t s) : tree(t), root(r), count(c), seq(s) {
+    std::lock_guard<std::mutex> lock(tree->pin_lock);
+    tree->pins.insert(seq);
+}
+
+/*
+Function Name: ~pin
+Description:
+    Unpins the version once the last view of it is gone.
+Input(s):
+    None
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+concurrent_btree<Key, Value, Compare>::pin::~pin() {
+    tree->unpin(seq);
+}
+
+/*
+Function Name: version
+Description:
+    Makes an empty view, not tied to any tree.
+Input(s):
+    None
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+concurrent_btree<Key, Value, Compare>::version::version() {}
+
+/*
+Function Name: version
+Description:
+    Makes a view of a pinned version. Used by snapshot().
+Input(s):
+    p - pin pointer reference. the pinned version.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+concurrent_btree<Key, Value, Compare>::version::version(const std::shared_ptr<const pin>& p) : state(p) {}
+
+// --------- PRIVATE Version Functions --------------
+
+/*
+Function Name: cut
+Description:
+    Cuts a subtree into the whole subtrees depth levels
+    down, in key order, and the nodes between them.
+    subtrees always ends up one longer than between.
+Input(s):
+    leaf - node pointer. subtree to cut, may be NULL.
+    depth - integer. levels to cut through.
+    subtrees - vector of node pointers. receives the pieces.
+    between - vector of node pointers. receives the nodes
+              between consecutive pieces.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+void concurrent_btree<Key, Value, Compare>::version::cut(const node *leaf, int depth, std::vector<const node *>& subtrees, std::vector<const node *>& between) {
+    if ((leaf == NULL) || (depth == 0)) {
+        subtrees.push_back(leaf);
+        return;
+    }
+    cut(leaf->left, depth - 1, subtrees, between);
+    between.push_back(leaf);
+    cut(leaf->right, depth - 1, subtrees, between);
+}
+
+/*
+Function Name: cut_pieces
+Description:
+    Cuts this version into whole subtrees about
+    piece_height high (at most 2^most_cuts of them) for a
+    parallel walk. Piece i is subtrees[i] followed by
+    between[i]. The cut depends only on the shape of the
+    version, not on the pool that walks it.
+Input(s):
+    subtrees - vector of node pointers. receives the pieces.
+    between - vector of node pointers. receives the nodes
+              between consecutive pieces.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+void concurrent_btree<Key, Value, Compare>::version::cut_pieces(std::vector<const node *>& subtrees, std::vector<const node *>& between) const {
+    if (!state) return;
+    int depth = height(state->root) - piece_height;
+    if (depth < 0) depth = 0;
+    if (depth > most_cuts) depth = most_cuts;
+    cut(state->root, depth, subtrees, between);
+}
+
+// --------- PUBLIC Version Functions --------------
+
+/*
+Function Name: contains
+Description:
+    Checks whether a key is in this version.
+Input(s):
+    key - key reference. key to look for.
+Return(s):
+    true - the key is in this version.
+    false - the key is not in this version.
+*/
+template <class Key, class Value, class Compare>
+bool concurrent_btree<Key, Value, Compare>::version::contains(const Key& key) const {
+    return state && (state->tree->find(state->root, key) != NULL);
+}
+
+/*
+Function Name: empty
+Description:
+    Checks whether this version holds no keys.
+Input(s):
+    None
+Return(s):
+    true - no keys.
+    false - at least one key.
+*/
+template <class Key, class Value, class Compare>
+bool concurrent_btree<Key, Value, Compare>::version::empty() const {
+    return size() == 0;
+}
+
+/*
+Function Name: for_each
+Description:
+    Calls visit(key, value) for every key in ascending
+    order, e.g. for a report or export of one consistent
+    version.
+Input(s):
+    visit - callable. called with each key and value.
+Return(s):
+    visited - size_t. number of keys visited.
+*/
+template <class Key, class Value, class Compare>
+template <class Visit>
+size_t concurrent_btree<Key, Value, Compare>::version::for_each(Visit visit) const {
+    if (!state) return 0;
+    return state->tree->walk(state->root, NULL, NULL, visit);
+}
+
+/*
+Function Name: max_item
+Description:
+    Gets the largest key of this version and its value.
+Input(s):
+    item - item reference. receives (key, value).
+Return(s):
+    true - the version was not empty.
+    false - the version was empty.
+*/
+template <class Key, class Value, class Compare>
+bool concurrent_btree<Key, Value, Compare>::version::max_item(item_type& item) const {
+    return state && edge_item(state->root, true, item);
+}
+
+/*
+Function Name: min_item
+Description:
+    Gets the smallest key of this version and its value.
+Input(s):
+    item - item reference. receives (key, value).
+Return(s):
+    true - the version was not empty.
+    false - the version was empty.
+*/
+template <class Key, class Value, class Compare>
+bool concurrent_btree<Key, Value, Compare>::version::min_item(item_type& item) const {
+    return state && edge_item(state->root, false, item);
+}
+
+/*
+Function Name: parallel_for_each
+Description:
+    Calls visit(key, value) for every key of this version,
+    cutting it into subtrees run across a thread pool. Each
+    piece is visited in ascending order, but pieces run at
+    the same time, so visit must be safe to call from
+    several threads.
+Input(s):
+    visit - callable. called with each key and value.
+    pool - thread_pool pointer. NULL to run in order on
+           this thread.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+template <class Visit>
+void concurrent_btree<Key, Value, Compare>::version::parallel_for_each(Visit visit, thread_pool *pool) const {
+    std::vector<const node *> subtrees;
+    std::vector<const node *> between;
+    cut_pieces(subtrees, between);
+    parallel_run(pool, subtrees.size(), [&](size_t i) {
+        state->tree->walk(subtrees[i], NULL, NULL, visit);
+        if (i < between.size()) visit(between[i]->key, between[i]->value);
+    });
+}
+
+/*
+Function Name: parallel_reduce
+Description:
+    Folds every key of this version into one result, in
+    parallel across a thread pool. Each piece starts from a
+    copy of init and adds its keys in ascending order; the
+    pieces are then combined left to right, so the result
+    is the same whatever the pool. init must leave a value
+    unchanged when combined with it (0 for sums).
+Input(s):
+    init - T. starting value of every piece and the result.
+    add - callable. add(T& acc, const Key& key, const Value& value).
+    combine - callable. combine(T& into, const T& part).
+    pool - thread_pool pointer. NULL to run in order on
+           this thread.
+Return(s):
+    result - T. every piece combined in key order.
+*/
+template <class Key, class Value, class Compare>
+template <class T, class Accumulate, class Combine>
+T concurrent_btree<Key, Value, Compare>::version::parallel_reduce(T init, Accumulate add, Combine combine, thread_pool *pool) const {
+    std::vector<const node *> subtrees;
+    std::vector<const node *> between;
+    cut_pieces(subtrees, between);
+
+    // deque rather than vector so a T of bool is one object per piece
+    std::deque<T> parts(subtrees.size(), init);
+    parallel_run(pool, subtrees.size(), [&](size_t i) {
+        T acc = init;
+        state->tree->walk(subtrees[i], NULL, NULL, [&](const Key& key, const Value& value) { add(acc, key, value); });
+        if (i < between.size()) add(acc, between[i]->key, between[i]->value);
+        parts[i] = std::move(acc);
+    });
+
+    T result = init;
+    for (size_t i = 0; i < parts.size(); i++) combine(result, parts[i]);
+    return result;
+}
+
+/*
+Function Name: scan
+Description:
+    Calls visit(key, value) for every key of this version
+    from lo through hi in ascending order.
+Input(s):
+    lo - key reference. smallest key to visit.
+    hi - key reference. largest key to visit.
+    visit - callable. called with each key and value.
+Return(s):
+    visited - size_t. number of keys visited.
+*/
+template <class Key, class Value, class Compare>
+template <class Visit>
+size_t concurrent_btree<Key, Value, Compare>::version::scan(const Key& lo, const Key& hi, Visit visit) const {
+    if (!state) return 0;
+    return state->tree->walk(state->root, &lo, &hi, visit);
+}
+
+/*
+Function Name: search
+Description:
+    Searches this version for a key and copies out its
+    value.
+Input(s):
+    key - key reference. key to look for.
+    value - value reference. receives the mapped value.
+Return(s):
+    true - the key was found.
+    false - the key is not in this version.
+*/
+template <class Key, class Value, class Compare>
+bool concurrent_btree<Key, Value, Compare>::version::search(const Key& key, Value& value) const {
+    if (!state) return false;
+    const node *leaf = state->tree->find(state->root, key);
+    if (leaf == NULL) return false;
+    value = leaf->value;
+    return true;
+}
+
+/*
+Function Name: size
+Description:
+    Gets the number of keys in this version.
+Input(s):
+    None
+Return(s):
+    count - size_t. number of keys.
+*/
+template <class Key, class Value, class Compare>
+size_t concurrent_btree<Key, Value, Compare>::version::size() const {
+    return state ? state->count : 0;
+}
+
+// --------- END Version Functions --------------
+
+// --------- BEGIN Class Functions --------------
+
+/*
+Function Name: concurrent_btree
+Description:
+    Concurrent tree function that will be called when the
+    tree is allocated/created. Epochs start at 1 so that 0
+    can mark a free reader slot.
+Input(s):
+    None
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+concurrent_btree<Key, Value, Compare>::concurrent_btree() : root(NULL), count(0), global_epoch(1), unpinned(false) {
+    for (size_t i = 0; i < reader_slots; i++) slots[i].epoch.store(0);
+    write_seq = 0;
+}
+
+/*
+Function Name: ~concurrent_btree
+Description:
+    Concurrent tree function that will be called when the
+    tree is deallocated/destroyed. No reader or version view
+    may still be using the tree. Frees the live nodes and
+    every retired or held node, then releases the pool.
+Input(s):
+    None
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+concurrent_btree<Key, Value, Compare>::~concurrent_btree() {
+    if (!std::is_trivially_destructible<node>::value) {
+        std::vector<node *> stack;
+        if (root.load() != NULL) stack.push_back(root.load());
+        while (!stack.empty()) {
+            node *leaf = stack.back();
+            stack.pop_back();
+            if (leaf->left != NULL) stack.push_back(leaf->left);
+            if (leaf->right != NULL) stack.push_back(leaf->right);
+            leaf->~node();
+        }
+        for (size_t i = 0; i < retired.size(); i++) {
+            for (size_t j = 0; j < retired[i].nodes.size(); j++) retired[i].nodes[j]->~node();
+        }
+        for (size_t i = 0; i < held.size(); i++) held[i].leaf->~node();
+    }
+    pool.release();
+}
+
+// --------- PRIVATE Class Functions --------------
+
+/*
+Function Name: edge_item
+Description:
+    Gets the smallest or largest key of a subtree and its
+    value.
+Input(s):
+    leaf - node pointer. root of the subtree.
+    largest - bool. true for the largest key.
+    item - item reference. receives (key, value).
+Return(s):
+    true - the subtree was not empty.
+    false - the subtree was empty.
+*/
+template <class Key, class Value, class Compare>
+bool concurrent_btree<Key, Value, Compare>::edge_item(const node *leaf, bool largest, item_type& item) {
+    if (leaf == NULL) return false;
+    if (largest) {
+        while (leaf->right != NULL) leaf = leaf->right;
+    } else {
+        while (leaf->left != NULL) leaf = leaf->left;
+    }
+    item = item_type(leaf->key, leaf->value);
+    return true;
+}
+
+/*
+Function Name: erase
+Description:
+    Removes the node with the given key from a subtree,
+    copying every node on the path that has to change.
+Input(s):
+    leaf - node pointer. current subtree root.
+    key - key reference. key to remove.
+    found - bool reference. set to true if the key was found.
+Return(s):
+    leaf - node pointer. new root of this subtree.
+*/
+template <class Key, class Value, class Compare>
+typename concurrent_btree<Key, Value, Compare>::node *
+concurrent_btree<Key, Value, Compare>::erase(node *leaf, const Key& key, bool& found) {
+    if (leaf == NULL) return NULL;
+
+    if (comp(key, leaf->key)) {
+        node *left = erase(leaf->left, key, found);
+        if (!found) return leaf;
+        leaf = own(leaf);
+        leaf->left = left;
+    } else if (comp(leaf->key, key)) {
+        node *right = erase(leaf->right, key, found);
+        if (!found) return leaf;
+        leaf = own(leaf);
+        leaf->right = right;
+    } else {
+        found = true;
+        replaced.push_back(leaf);
+        if (leaf->left == NULL) return leaf->right;
+        if (leaf->right == NULL) return leaf->left;
+
+        // ------ Two Children: Successor Takes Its Place ------
+        node *min = NULL;
+        node *right = erase_min(leaf->right, min);
+        min = own(min);
+        min->left = leaf->left;
+        min->right = right;
+        leaf = min;
+    }
+    return rebalance(leaf);
+}
+
+/*
+Function Name: erase_min
+Description:
+    Unlinks the smallest node of a subtree, copying the
+    path down to it.
+Input(s):
+    leaf - node pointer. current subtree root.
+    min - node pointer reference. receives the unlinked node.
+Return(s):
+    leaf - node pointer. new root of this subtree.
+*/
+template <class Key, class Value, class Compare>
+typename concurrent_btree<Key, Value, Compare>::node *
+concurrent_btree<Key, Value, Compare>::erase_min(node *leaf, node *&min) {
+    if (leaf->left == NULL) {
+        min = leaf;
+        return leaf->right;
+    }
+    node *left = erase_min(leaf->left, min);
+    leaf = own(leaf);
+    leaf->left = left;
+    return rebalance(leaf);
+}
+
+/*
+Function Name: find
+Description:
+    Searches a subtree for a key.
+Input(s):
+    leaf - node pointer. root of the subtree.
+    key - key reference. key to look for.
+Return(s):
+    leaf - node pointer. node holding the key.
+    NULL - the key is not in the subtree.
+*/
+template <class Key, class Value, class Compare>
+const typename concurrent_btree<Key, Value, Compare>::node *
+concurrent_btree<Key, Value, Compare>::find(const node *leaf, const Key& key) const {
+    while (leaf != NULL) {
+        if (comp(key, leaf->key)) leaf = leaf->left;
+        else if (comp(leaf->key, key)) leaf = leaf->right;
+        else return leaf;
+    }
+    return NULL;
+}
+
+/*
+Function Name: free_node
+Description:
+    Destroys a node and hands it back to the pool.
+    Writers only.
+Input(s):
+    leaf - node pointer. node to free.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+void concurrent_btree<Key, Value, Compare>::free_node(node *leaf) {
+    leaf->~node();
+    pool.deallocate(leaf);
+}
+
+/*
+Function Name: height
+Description:
+    Gets the height of a subtree.
+Input(s):
+    leaf - node pointer. root of the subtree.
+Return(s):
+    height - integer. 0 for an empty subtree.
+*/
+template <class Key, class Value, class Compare>
+int concurrent_btree<Key, Value, Compare>::height(const node *leaf) {
+    if (leaf != NULL) return leaf->height;
+    else return 0;
+}
+
+/*
+Function Name: insert
+Description:
+    Inserts a key into a subtree, copying every node on the
+    path that has to change. Nothing is copied when the key
+    is already there.
+Input(s):
+    leaf - node pointer. current subtree root.
+    key - key reference. key to insert.
+    value - value reference. mapped value for the key.
+    inserted - bool reference. set to true if a node was added.
+Return(s):
+    leaf - node pointer. new root of this subtree.
+*/
+template <class Key, class Value, class Compare>
+typename concurrent_btree<Key, Value, Compare>::node *
+concurrent_btree<Key, Value, Compare>::insert(node *leaf, const Key& key, const Value& value, bool& inserted) {
+    if (leaf == NULL) {
+        inserted = true;
+        return new_node(key, value);
+    }
+
+    if (comp(key, leaf->key)) {
+        node *left = insert(leaf->left, key, value, inserted);
+        if (!inserted) return leaf;
+        leaf = own(leaf);
+        leaf->left = left;
+    } else if (comp(leaf->key, key)) {
+        node *right = insert(leaf->right, key, value, inserted);
+        if (!inserted) return leaf;
+        leaf = own(leaf);
+        leaf->right = right;
+    } else {
+        return leaf;
+    }
+    return rebalance(leaf);
+}
+
+/*
+Function Name: new_node
+Description:
+    Allocates a node stamped with the current write.
+Input(s):
+    key - key reference. key for the new node.
+    value - value reference. mapped value for the new node.
+Return(s):
+    leaf - node pointer. the new node.
+*/
+template <class Key, class Value, class Compare>
+typename concurrent_btree<Key, Value, Compare>::node *
+concurrent_btree<Key, Value, Compare>::new_node(const Key& key, const Value& value) {
+    return new (pool.allocate()) node(key, value, write_seq);
+}
+
+/*
+Function Name: own
+Description:
+    Gets a version of a node the current write may change.
+    Nodes made by this write are changed in place; published
+    nodes are copied and the original is queued for retiring.
+Input(s):
+    leaf - node pointer. node about to be changed.
+Return(s):
+    leaf - node pointer. private copy of the node.
+*/
+template <class Key, class Value, class Compare>
+typename concurrent_btree<Key, Value, Compare>::node *
+concurrent_btree<Key, Value, Compare>::own(node *leaf) {
+    if (leaf->birth == write_seq) return leaf;
+
+    node *copy = new_node(leaf->key, leaf->value);
+    copy->height = leaf->height;
+    copy->left = leaf->left;
+    copy->right = leaf->right;
+    replaced.push_back(leaf);
+    return copy;
+}
+
+/*
+Function Name: pinned
+Description:
+    Checks whether a replaced node is still part of a pinned
+    version: one that includes the write the node was born
+    in but not the write that replaced it. Called with the
+    pin lock held.
+Input(s):
+    leaf - node pointer. replaced node.
+    seq - uint64_t. write that replaced the node.
+Return(s):
+    true - a pinned version still contains the node.
+    false - the node can be freed once readers are done.
+*/
+template <class Key, class Value, class Compare>
+bool concurrent_btree<Key, Value, Compare>::pinned(const node *leaf, uint64_t seq) const {
+    typename std::multiset<uint64_t>::const_iterator it = pins.lower_bound(leaf->birth);
+    return (it != pins.end()) && (*it < seq);
+}
+
+/*
+Function Name: publish
+Description:
+    Makes a new root visible to readers, then retires the
+    nodes the write replaced and frees whatever no reader
+    can still see.
+Input(s):
+    leaf - node pointer. new root.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+void concurrent_btree<Key, Value, Compare>::publish(node *leaf) {
+    root.store(leaf, std::memory_order_seq_cst);
+
+    if (!replaced.empty()) {
+        retired_batch batch;
+        batch.epoch = global_epoch.fetch_add(1, std::memory_order_seq_cst);
+        batch.seq = write_seq;
+        batch.nodes.swap(replaced);
+        retired.push_back(batch);
+    }
+    reclaim();
+}
+
+/*
+Function Name: reclaim
+Description:
+    Frees retired batches that no reader can reach. A batch
+    retired in epoch E is safe once every reader in a slot
+    entered after E, since those readers loaded the root
+    after the nodes were unlinked. Nodes of a safe batch
+    that a pinned version still contains move to held, which
+    is checked again whenever a version gets unpinned.
+Input(s):
+    None
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+void concurrent_btree<Key, Value, Compare>::reclaim() {
+    std::lock_guard<std::mutex> lock(pin_lock);
+    if (unpinned) {
+        size_t still = 0;
+        for (size_t i = 0; i < held.size(); i++) {
+            if (pinned(held[i].leaf, held[i].seq)) held[still++] = held[i];
+            else free_node(held[i].leaf);
+        }
+        held.resize(still);
+        unpinned = false;
+    }
+    if (retired.empty()) return;
+
+    uint64_t oldest = global_epoch.load(std::memory_order_seq_cst);
+    for (size_t i = 0; i < reader_slots; i++) {
+        uint64_t epoch = slots[i].epoch.load(std::memory_order_seq_cst);
+        if ((epoch != 0) && (epoch < oldest)) oldest = epoch;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < retired.size(); i++) {
+        if (retired[i].epoch < oldest) {
+            for (size_t j = 0; j < retired[i].nodes.size(); j++) {
+                node *leaf = retired[i].nodes[j];
+                if (pins.empty() || !pinned(leaf, retired[i].seq)) {
+                    free_node(leaf);
+                } else {
+                    held_node keep = {leaf, retired[i].seq};
+                    held.push_back(keep);
+                }
+            }
+        } else {
+            if (kept != i) std::swap(retired[kept], retired[i]);
+            kept++;
+        }
+    }
+    retired.resize(kept);
+}
+
+/*
+Function Name: rebalance
+Description:
+    Restores the AVL property at a node this write owns,
+    taking ownership of any child that has to rotate.
+Input(s):
+    leaf - node pointer. node to rebalance (owned).
+Return(s):
+    leaf - node pointer. new root of this subtree.
+*/
+template <class Key, class Value, class Compare>
+typename concurrent_btree<Key, Value, Compare>::node *
+concurrent_btree<Key, Value, Compare>::rebalance(node *leaf) {
+    update_node(leaf);
+
+    int balance = height(leaf->left) - height(leaf->right);
+    if (balance > 1) {
+        if (height(leaf->left->left) < height(leaf->left->right))
+            leaf->left = rotate_left(own(leaf->left));
+        return rotate_right(leaf);
+    } else if (balance < -1) {
+        if (height(leaf->right->right) < height(leaf->right->left))
+            leaf->right = rotate_right(own(leaf->right));
+        return rotate_left(leaf);
+    }
+    return leaf;
+}
+
+/*
+Function Name: rotate_left
+Description:
+    Rotates an owned subtree to the left. The right child
+    is taken over (copied if published) and becomes the new
+    subtree root.
+Input(s):
+    leaf - node pointer. current subtree root (owned).
+Return(s):
+    pivot - node pointer. new subtree root.
+*/
+template <class Key, class Value, class Compare>
+typename concurrent_btree<Key, Value, Compare>::node *
+concurrent_btree<Key, Value, Compare>::rotate_left(node *leaf) {
+    node *pivot = own(leaf->right);
+    leaf->right = pivot->left;
+    pivot->left = leaf;
+    update_node(leaf);
+    update_node(pivot);
+    return pivot;
+}
+
+/*
+Function Name: rotate_right
+Description:
+    Rotates an owned subtree to the right. The left child
+    is taken over (copied if published) and becomes the new
+    subtree root.
+Input(s):
+    leaf - node pointer. current subtree root (owned).
+Return(s):
+    pivot - node pointer. new subtree root.
+*/
+template <class Key, class Value, class Compare>
+typename concurrent_btree<Key, Value, Compare>::node *
+concurrent_btree<Key, Value, Compare>::rotate_right(node *leaf) {
+    node *pivot = own(leaf->left);
+    leaf->left = pivot->right;
+    pivot->right = leaf;
+    update_node(leaf);
+    update_node(pivot);
+    return pivot;
+}
+
+/*
+Function Name: unpin
+Description:
+    Drops one pin on a version so the nodes only it kept
+    alive are freed on the next write.
+Input(s):
+    seq - uint64_t. write the pinned version ends at.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+void concurrent_btree<Key, Value, Compare>::unpin(uint64_t seq) const {
+    std::lock_guard<std::mutex> lock(pin_lock);
+    pins.erase(pins.find(seq));
+    unpinned = true;
+}
+
+/*
+Function Name: update_node
+Description:
+    Recomputes the height of a node from its children.
+Input(s):
+    leaf - node pointer. node to update.
+Return(s):
+    None
+*/
+template <class Key, class Value, class Compare>
+void concurrent_btree<Key, Value, Compare>::update_node(node *leaf) {
+    int lh = height(leaf->left);
+    int rh = height(leaf->right);
+    leaf->height = (lh > rh ? lh : rh) + 1;
+}
+
+/*
+Function Name: walk
+Description:
+    Calls visit(key, value) for every key of a subtree
+    from lo through hi in ascending order.
+
+    Walks with a fixed stack of ancestors; an AVL tree of
+    any size that fits in memory is far shallower than it.
+Input(s):
+    leaf - node pointer. root of the subtree.
+    lo - key pointer. smallest key to visit, NULL for no limit.
+    hi - key pointer. largest key to visit, NULL for no limit.
+    visit - callable. called with each key and value.
+Return(s):
+    visited - size_t. number of keys visited.
+*/
+template <class Key, class Value, class Compare>
+template <class Visit>
+size_t concurrent_btree<Key, Value, Compare>::walk(const node *leaf, const Key *lo, const Key *hi, Visit visit) const {
+    const node *stack[128];
+    int depth = 0;
+    size_t visited = 0;
+
+    while ((leaf != NULL) || (depth > 0)) {
+        while (leaf != NULL) {
+            if ((lo != NULL) && comp(leaf->key, *lo)) {
+                leaf = leaf->right;
+            } else {
+                stack[depth++] = leaf;
+                leaf = leaf->left;
+            }
+        }
+        if (depth == 0) break;
+
+        leaf = stack[--depth];
+        if ((hi != NULL) && comp(*hi, leaf->key)) break;
+        visit(leaf->key, leaf->value);
+        visited++;
+        leaf = leaf->right;
+    }
+    return visited;
+}
+
+// --------- PUBLIC Class Functions --------------
+
+/*
+Function Name: contains
+Description:
+    Checks whether a key is in the tree. Lock-free.
+Input(s):
+    key - key reference. key to look for.
+Return(s):
+    true - the key is in the tree.
+    false - the key is not in the tree.
+*/
+template <class Key, class Value, class Compare>
+bool concurrent_btree<Key, Value, Compare>::contains(const Key& key) const {
+    Value value;
+    return search(key, value);
+}
+
+/*
+Function Name: erase
+Description:
+    Removes a key from the tree. Writers take turns; readers
+    keep seeing the previous version until the new root is
+    published.
+Input(s):
+    key - key reference. key to remove.
+Return(s):
+    true - the key was removed.
+    false - the key was not in the tree.
+*/
+template <class Key, class Value, class Compare>
+bool concurrent_btree<Key, Value, Compare>::erase(const Key& key) {
+    std::lock_guard<std::mutex> lock(writer_lock);
+    write_seq++;
+
+    bool found = false;
+    node *leaf = erase(root.load(std::memory_order_relaxed), key, found);
+    if (found) {
+        count.fetch_sub(1, std::memory_order_relaxed);
+        publish(leaf);
+    }
+    return found;
+}
+
+/*
+Function Name: insert
+Description:
+    Inserts a key into the tree unless it is already there.
+    Writers take turns; readers keep seeing the previous
+    version until the new root is published.
+Input(s):
+    key - key reference. key to insert.
+    value - value reference. mapped value for the key.
+Return(s):
+    true - the key was added.
+    false - the key was already in the tree.
+*/
+template <class Key, class Value, class Compare>
+bool concurrent_btree<Key, Value, Compare>::insert(const Key& key, const Value& value) {
+    std::lock_guard<std::mutex> lock(writer_lock);
+    write_seq++;
+
+    bool inserted = false;
+    node *leaf = insert(root.load(std::memory_order_relaxed), key, value, inserted);
+    if (inserted) {
+        count.fetch_add(1, std::memory_order_relaxed);
+        publish(leaf);
+    }
+    return inserted;
+}
+
+/*
+Function Name: max_item
+Description:
+    Gets the largest key and its value. Lock-free.
+Input(s):
+    item - item reference. receives (key, value).
+Return(s):
+    true - the tree was not empty.
+    false - the tree was empty.
+*/
+template <class Key, class Value, class Compare>
+bool concurrent_btree<Key, Value, Compare>::max_item(item_type& item) const {
+    read_guard guard(*this);
+    return edge_item(root.load(std::memory_order_acquire), true, item);
+}
+
+/*
+Function Name: min_item
+Description:
+    Gets the smallest key and its value. Lock-free.
+Input(s):
+    item - item reference. receives (key, value).
+Return(s):
+    true - the tree was not empty.
+    false - the tree was empty.
+*/
+template <class Key, class Value, class Compare>
+bool concurrent_btree<Key, Value, Compare>::min_item(item_type& item) const {
+    read_guard guard(*this);
+    return edge_item(root.load(std::memory_order_acquire), false, item);
+}
+
+/*
+Function Name: pending
+Description:
+    Counts the retired nodes still waiting for readers to
+    move on or for pinned versions to be dropped.
+Input(s):
+    None
+Return(s):
+    pending - size_t. nodes not yet freed.
+*/
+template <class Key, class Value, class Compare>
+size_t concurrent_btree<Key, Value, Compare>::pending() const {
+    std::lock_guard<std::mutex> lock(writer_lock);
+    size_t n = 0;
+    for (size_t i = 0; i < retired.size(); i++) n += retired[i].nodes.size();
+    return n + held.size();
+}
+
+/*
+Function Name: scan
+Description:
+    Calls visit(key, value) for every key from lo through
+    hi in ascending order. Lock-free, and the whole scan
+    sees one version of the tree even while writers run.
+Input(s):
+    lo - key reference. smallest key to visit.
+    hi - key reference. largest key to visit.
+    visit - callable. called with each key and value.
+Return(s):
+    visited - size_t. number of keys visited.
+*/
+template <class Key, class Value, class Compare>
+template <class Visit>
+size_t concurrent_btree<Key, Value, Compare>::scan(const Key& lo, const Key& hi, Visit visit) const {
+    read_guard guard(*this);
+    return walk(root.load(std::memory_order_acquire), &lo, &hi, visit);
+}
+
+/*
+Function Name: search
+Description:
+    Searches the tree for a key and copies out its value.
+    Lock-free.
+Input(s):
+    key - key reference. key to look for.
+    value - value reference. receives the mapped value.
+Return(s):
+    true - the key was found.
+    false - the key is not in the tree.
+*/
+template <class Key, class Value, class Compare>
+bool concurrent_btree<Key, Value, Compare>::search(const Key& key, Value& value) const {
+    read_guard guard(*this);
+    const node *leaf = find(root.load(std::memory_order_acquire), key);
+    if (leaf == NULL) return false;
+    value = leaf->value;
+    return true;
+}
+
+/*
+Function Name: snapshot
+Description:
+    Pins the current version of the tree in O(1) and gets a
+    read-only view of it. The view (and its copies) keeps
+    seeing exactly this version while writers go on; the
+    nodes only it still uses are freed on the first write
+    after the last copy is dropped.
+Input(s):
+    None
+Return(s):
+    view - version. view of the current version.
+*/
+template <class Key, class Value, class Compare>
+typename concurrent_btree<Key, Value, Compare>::version concurrent_btree<Key, Value, Compare>::snapshot() const {
+    std::lock_guard<std::mutex> lock(writer_lock);
+    std::shared_ptr<const pin> p = std::make_shared<pin>(this, root.load(std::memory_order_relaxed), count.load(std::memory_order_relaxed), write_seq);
+    return version(p);
+}
+
+/*
+Function Name: size
+Description:
+    Gets the number of keys in the tree.
+Input(s):
+    None
+Return(s):
+    count - size_t. number of keys.
+*/
+template <class Key, class Value, class Compare>
+size_t concurrent_btree<Key, Value, Compare>::size() const {
+    return count.load(std::memory_order_relaxed);
+}
+
+// --------- END Class Functions --------------
+
+#endif
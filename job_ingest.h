@@ -0,0 +1,472 @@
+/*
+Created By: Thomas Osgood
+
+Description:
+    Bulk CSV/TSV ingest of job feeds into a job_tree.
+
+    Rows are "year,job_number,job_cost,job_estimate" (cost
+    and estimate may be left off, like new_job). A first
+    line that does not start with a digit is taken as a
+    header and skipped. The delimiter is ',' or '\t',
+    picked from the first row unless given.
+
+    Pipeline:
+        1) mmap the file and cut it into one chunk per
+           thread, each chunk ending on a line break.
+        2) every thread parses its chunk (hand rolled int
+           parsing, std::from_chars for floats) into
+           (key, data) items and sorts them by key.
+        3) the sorted chunks are merged in pairs, in
+           parallel, keeping file order for equal keys.
+        4) one pass drops duplicates (the first row of a
+           job wins). An empty tree is then built in linear
+           time with job_tree::build_from_items; otherwise
+           only the new jobs are inserted, jobs already in
+           the tree win over the file and keep their nodes.
+
+    Duplicates and rows that do not parse are counted and
+    the first report_limit of each are listed in the
+    result, instead of printing a warning per row.
+
+    To Use:
+    job_ingest ingest;
+    job_ingest_result result;
+    ingest.load_file("jobs.csv", jobs, result);
+*/
+#ifndef JOB_INGEST_H
+#define JOB_INGEST_H
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "job_tree.h"
+
+/*
+    Create Structure For Ingest Results
+*/
+struct job_ingest_result {
+    size_t rows; // data rows read (not counting blanks or the header)
+    size_t inserted; // jobs added to the tree
+    size_t duplicates; // rows for a job that was already seen
+    size_t bad_rows; // rows that did not parse
+    std::vector<job_key> duplicate_jobs; // first report_limit duplicates
+    std::vector<size_t> bad_lines; // first report_limit bad line numbers (1 based)
+};
+
+/*
+    Define Job Ingest Class
+*/
+class job_ingest {
+
+public:
+    typedef job_tree::item_type item_type;
+
+    job_ingest(unsigned int threads = 0, char delimiter = 0, size_t report_limit = 1000);
+    void load(const char *data, size_t size, job_tree& jobs, job_ingest_result& result) const;
+    bool load_file(const char *path, job_tree& jobs, job_ingest_result& result) const;
+
+private:
+    /*
+        Create Structure For One Parsed Chunk
+    */
+    struct chunk {
+        const char *first;
+        const char *last;
+        size_t lines; // line breaks seen in the chunk
+        size_t rows;
+        std::vector<item_type> items;
+        std::vector<size_t> bad_lines; // line numbers within the chunk
+        size_t bad_rows;
+    };
+
+    static bool before(const item_type& a, const item_type& b);
+    static std::vector<item_type> merge_all(std::vector<std::vector<item_type> >& runs);
+    void parse(chunk& part, char delim) const;
+    static void radix_sort(std::vector<item_type>& items);
+    static bool parse_float(const char *&pos, const char *end, float& value);
+    static bool parse_uint(const char *&pos, const char *end, unsigned int& value);
+
+    char delimiter; // 0 to detect from the first row
+    size_t report_limit;
+    unsigned int threads;
+};
+
+// --------- BEGIN Class Functions --------------
+
+/*
+Function Name: job_ingest
+Description:
+    Sets up an ingest pipeline.
+Input(s):
+    threads - unsigned int. parser threads, 0 for one per core.
+    delimiter - char. ',' or '\t', 0 to detect it.
+    report_limit - size_t. most duplicates / bad lines to list.
+Return(s):
+    None
+*/
+inline job_ingest::job_ingest(unsigned int threads, char delimiter, size_t report_limit) :
+    delimiter(delimiter), report_limit(report_limit), threads(threads) {
+    if (this->threads == 0) this->threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+// --------- PRIVATE Class Functions --------------
+
+/*
+Function Name: before
+Description:
+    Orders parsed items by packed job key.
+Input(s):
+    a - item reference. left item.
+    b - item reference. right item.
+Return(s):
+    true - a's job comes before b's.
+*/
+inline bool job_ingest::before(const item_type& a, const item_type& b) {
+    return a.first.packed < b.first.packed;
+}
+
+/*
+Function Name: merge_all
+Description:
+    Merges sorted runs into one sorted run. Neighbouring
+    runs are merged in pairs, each pair on its own thread,
+    until one is left. std::merge takes equal keys from the
+    left run first, so earlier runs win ties.
+Input(s):
+    runs - vector of sorted item vectors. emptied.
+Return(s):
+    items - vector of items, sorted.
+*/
+inline std::vector<job_ingest::item_type> job_ingest::merge_all(std::vector<std::vector<item_type> >& runs) {
+    if (runs.empty()) return std::vector<item_type>();
+    while (runs.size() > 1) {
+        std::vector<std::vector<item_type> > merged((runs.size() + 1) / 2);
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i + 1 < runs.size(); i += 2) {
+            workers.push_back(std::thread([&runs, &merged, i]() {
+                std::vector<item_type>& out = merged[i / 2];
+                out.resize(runs[i].size() + runs[i + 1].size());
+                std::merge(runs[i].begin(), runs[i].end(), runs[i + 1].begin(), runs[i + 1].end(), out.begin(), before);
+                std::vector<item_type>().swap(runs[i]);
+                std::vector<item_type>().swap(runs[i + 1]);
+            }));
+        }
+        if (runs.size() % 2 == 1) merged.back().swap(runs.back());
+        for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+        runs.swap(merged);
+    }
+    return std::move(runs[0]);
+}
+
+/*
+Function Name: parse
+Description:
+    Parses every line of a chunk into items, counting bad
+    rows, then sorts the items by key, keeping file order
+    for equal keys. Already sorted feeds skip the sort.
+Input(s):
+    part - chunk reference. chunk to parse.
+    delim - char. field delimiter.
+Return(s):
+    None
+*/
+inline void job_ingest::parse(chunk& part, char delim) const {
+    const char *pos = part.first;
+    const char *end = part.last;
+    part.lines = 0;
+    part.rows = 0;
+    part.bad_rows = 0;
+    part.items.reserve((end - pos) / 24);
+
+    while (pos < end) {
+        const char *eol = static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+        if (eol == NULL) eol = end;
+        const char *stop = ((eol > pos) && (eol[-1] == '\r')) ? eol - 1 : eol;
+        size_t line = part.lines++;
+
+        if (stop > pos) {
+            part.rows++;
+            unsigned int year;
+            unsigned int jno;
+            job_data data = {0.0f, 0.0f};
+            const char *p = pos;
+            bool ok = parse_uint(p, stop, year) && (p < stop) && (*p++ == delim) && parse_uint(p, stop, jno);
+            if (ok && (p < stop)) ok = (*p++ == delim) && parse_float(p, stop, data.job_cost);
+            if (ok && (p < stop)) ok = (*p++ == delim) && parse_float(p, stop, data.job_estimate);
+            if (ok && (p == stop)) {
+                part.items.push_back(item_type(job_key(year, jno), data));
+            } else {
+                part.bad_rows++;
+                if (part.bad_lines.size() < report_limit) part.bad_lines.push_back(line);
+            }
+        }
+        pos = eol + 1;
+    }
+
+    if (!std::is_sorted(part.items.begin(), part.items.end(), before)) radix_sort(part.items);
+}
+
+/*
+Function Name: parse_float
+Description:
+    Parses a float. Plain decimals with at most 7 significant
+    digits and 10 decimals (e.g. 4180.69), which is nearly
+    every money amount, are read as an integer and divided
+    by a power of ten: both fit a float exactly, so that one
+    division is correctly rounded. Anything else (exponents,
+    long mantissas) goes through std::from_chars. One sign
+    is allowed, so "+-5" is not a number. NaN, infinity and
+    values that overflow a float are rejected: a NaN would
+    break the ordering of the secondary indexes and both
+    would poison the cost and profit sums.
+Input(s):
+    pos - char pointer reference. moved past the number.
+    end - char pointer. end of the field data.
+    value - float reference. receives the number.
+Return(s):
+    true - a number was parsed.
+    false - not a finite number.
+*/
+inline bool job_ingest::parse_float(const char *&pos, const char *end, float& value) {
+    static const float powers[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+
+    // from_chars takes '-' but not '+', so a '+' is skipped here
+    const char *number = ((pos < end) && (*pos == '+')) ? pos + 1 : pos;
+    if ((number != pos) && (number < end) && (*number == '-')) return false;
+    const char *p = number;
+    bool negative = (p < end) && (*p == '-');
+    if (negative) p++;
+
+    uint32_t mantissa = 0;
+    int digits = 0;
+    int decimals = 0;
+    for (; (p < end) && ((unsigned char)(*p - '0') < 10) && (digits < 9); p++, digits++) mantissa = mantissa * 10 + (*p - '0');
+    if ((p < end) && (*p == '.')) {
+        for (p++; (p < end) && ((unsigned char)(*p - '0') < 10) && (digits < 9); p++, digits++, decimals++)
+            mantissa = mantissa * 10 + (*p - '0');
+    }
+
+    bool simple = (digits > 0) && (mantissa <= (1u << 24)) && (decimals <= 10) &&
+        ((p == end) || (((unsigned char)(*p - '0') >= 10) && (*p != 'e') && (*p != 'E') && (*p != '.')));
+    if (simple) {
+        value = (float)mantissa / powers[decimals];
+        if (negative) value = -value;
+        pos = p;
+        return true;
+    }
+
+    float parsed;
+    std::from_chars_result result = std::from_chars(number, end, parsed);
+    if ((result.ec != std::errc()) || (result.ptr == number) || !std::isfinite(parsed)) return false;
+    value = parsed;
+    pos = result.ptr;
+    return true;
+}
+
+/*
+Function Name: parse_uint
+Description:
+    Parses an unsigned 32 bit number, digit by digit.
+Input(s):
+    pos - char pointer reference. moved past the number.
+    end - char pointer. end of the field data.
+    value - unsigned int reference. receives the number.
+Return(s):
+    true - at least one digit and no overflow.
+*/
+inline bool job_ingest::parse_uint(const char *&pos, const char *end, unsigned int& value) {
+    const char *start = pos;
+    uint64_t n = 0;
+    while ((pos < end) && ((unsigned char)(*pos - '0') < 10)) {
+        n = n * 10 + (*pos - '0');
+        if (n > UINT32_MAX) return false;
+        pos++;
+    }
+    value = (unsigned int)n;
+    return pos != start;
+}
+
+/*
+Function Name: radix_sort
+Description:
+    Stable LSD radix sort on the packed key, 16 bits per
+    pass. Passes over bits that every key shares (e.g. the
+    high bits of the year) are skipped, so a feed of a few
+    years usually sorts in 2-3 linear passes.
+Input(s):
+    items - vector of items reference. sorted in place.
+Return(s):
+    None
+*/
+inline void job_ingest::radix_sort(std::vector<item_type>& items) {
+    uint64_t all_or = 0;
+    uint64_t all_and = ~0ULL;
+    for (size_t i = 0; i < items.size(); i++) {
+        all_or |= items[i].first.packed;
+        all_and &= items[i].first.packed;
+    }
+    uint64_t varying = all_or ^ all_and;
+
+    std::vector<item_type> buffer(items.size());
+    std::vector<size_t> counts(65536);
+    for (int shift = 0; shift < 64; shift += 16) {
+        if (((varying >> shift) & 0xFFFF) == 0) continue;
+
+        std::fill(counts.begin(), counts.end(), 0);
+        for (size_t i = 0; i < items.size(); i++) counts[(items[i].first.packed >> shift) & 0xFFFF]++;
+        size_t total = 0;
+        for (size_t d = 0; d < counts.size(); d++) {
+            size_t n = counts[d];
+            counts[d] = total;
+            total += n;
+        }
+        for (size_t i = 0; i < items.size(); i++) buffer[counts[(items[i].first.packed >> shift) & 0xFFFF]++] = items[i];
+        items.swap(buffer);
+    }
+}
+
+// --------- PUBLIC Class Functions --------------
+
+/*
+Function Name: load
+Description:
+    Ingests CSV/TSV text from memory into a job tree. Jobs
+    already in the tree are kept, nodes and all; rows for
+    them count as duplicates. An empty tree is built in
+    linear time, a loaded one takes O(log n) per new job.
+Input(s):
+    data - char pointer. feed text.
+    size - size_t. length of the text.
+    jobs - job tree reference. tree to load into.
+    result - job_ingest_result reference. filled in.
+Return(s):
+    None
+*/
+inline void job_ingest::load(const char *data, size_t size, job_tree& jobs, job_ingest_result& result) const {
+    result = job_ingest_result();
+    const char *pos = data;
+    const char *end = data + size;
+    size_t first_line = 1;
+
+    // ------ Header & Delimiter ------
+    if ((pos < end) && ((unsigned char)(*pos - '0') >= 10)) {
+        const char *eol = static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+        pos = (eol != NULL) ? eol + 1 : end;
+        first_line = 2;
+    }
+    char delim = delimiter;
+    if (delim == 0) {
+        const char *eol = static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+        if (eol == NULL) eol = end;
+        delim = (std::memchr(pos, '\t', eol - pos) != NULL) ? '\t' : ',';
+    }
+
+    // ------ Cut Into Chunks On Line Breaks ------
+    size_t parts = std::max<size_t>(1, std::min<size_t>(threads, (end - pos) / 65536 + 1));
+    std::vector<chunk> chunks(parts);
+    for (size_t i = 0; i < parts; i++) {
+        chunks[i].first = (i == 0) ? pos : chunks[i - 1].last;
+        const char *cut = pos + (end - pos) * (i + 1) / parts;
+        if (cut < chunks[i].first) cut = chunks[i].first;
+        const char *eol = (i + 1 == parts) ? NULL : static_cast<const char *>(std::memchr(cut, '\n', end - cut));
+        chunks[i].last = (eol != NULL) ? eol + 1 : end;
+    }
+
+    // ------ Parse & Sort Chunks In Parallel ------
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < parts; i++) workers.push_back(std::thread(&job_ingest::parse, this, std::ref(chunks[i]), delim));
+    parse(chunks[0], delim);
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+
+    // ------ Merge ------
+    std::vector<std::vector<item_type> > runs;
+    size_t line = first_line;
+    for (size_t i = 0; i < parts; i++) {
+        result.rows += chunks[i].rows;
+        result.bad_rows += chunks[i].bad_rows;
+        for (size_t b = 0; (b < chunks[i].bad_lines.size()) && (result.bad_lines.size() < report_limit); b++)
+            result.bad_lines.push_back(line + chunks[i].bad_lines[b]);
+        line += chunks[i].lines;
+        runs.push_back(std::vector<item_type>());
+        runs.back().swap(chunks[i].items);
+    }
+    size_t existing = jobs.size();
+    std::vector<item_type> items = merge_all(runs);
+
+    // ------ Drop Duplicates, First One Wins ------
+    size_t kept = 0;
+    for (size_t i = 0; i < items.size(); i++) {
+        if ((kept > 0) && (items[kept - 1].first.packed == items[i].first.packed)) {
+            result.duplicates++;
+            if (result.duplicate_jobs.size() < report_limit) result.duplicate_jobs.push_back(items[i].first);
+            continue;
+        }
+        if (kept != i) items[kept] = items[i];
+        kept++;
+    }
+    items.resize(kept);
+
+    // ------ Build, Or Add To The Jobs Already There ------
+    if (existing == 0) {
+        jobs.build_from_items(items.begin(), items.end());
+    } else {
+        for (size_t i = 0; i < items.size(); i++) {
+            if (jobs.insert_unique(items[i].first, items[i].second).second) continue;
+            result.duplicates++;
+            if (result.duplicate_jobs.size() < report_limit) result.duplicate_jobs.push_back(items[i].first);
+        }
+    }
+    result.inserted = jobs.size() - existing;
+}
+
+/*
+Function Name: load_file
+Description:
+    Maps a CSV/TSV file read-only and ingests it.
+Input(s):
+    path - char pointer. feed file.
+    jobs - job tree reference. tree to load into.
+    result - job_ingest_result reference. filled in.
+Return(s):
+    true - the file was read (see result for bad rows).
+    false - the file could not be opened or mapped.
+*/
+inline bool job_ingest::load_file(const char *path, job_tree& jobs, job_ingest_result& result) const {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+    if (info.st_size == 0) {
+        ::close(fd);
+        load("", 0, jobs, result);
+        return true;
+    }
+
+    void *map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return false;
+    madvise(map, info.st_size, MADV_SEQUENTIAL);
+
+    load(static_cast<const char *>(map), info.st_size, jobs, result);
+    munmap(map, info.st_size);
+    return true;
+}
+
+// --------- END Class Functions --------------
+
+#endif
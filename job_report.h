@@ -0,0 +1,374 @@
+/*
+Created By: Thomas Osgood
+
+Description:
+    Job report renderer used by job_tree::print_ascending()
+    and print_descending().
+
+    The locale (thousands separator, decimal point and
+    currency symbol) is read once when the report is made.
+    Jobs are then formatted by hand into a 1MB buffer that
+    is written out in one call per megabyte, so there is no
+    per-node imbue() and no per-line flush.
+
+    Layouts:
+        JOB_REPORT_TEXT - the boxed report printed by job_sorter,
+                          amounts in the locale's currency format.
+        JOB_REPORT_CSV  - header line, then one comma separated
+                          line per job with plain amounts.
+        JOB_REPORT_TSV  - same as CSV, tab separated.
+*/
+#ifndef JOB_REPORT_H
+#define JOB_REPORT_H
+
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <locale>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+enum job_report_layout { JOB_REPORT_TEXT, JOB_REPORT_CSV, JOB_REPORT_TSV };
+
+class job_report {
+
+public:
+    job_report(job_report_layout layout = JOB_REPORT_TEXT, const char *locale_name = "");
+    job_report(job_report_layout layout, const std::locale& loc);
+    size_t header(char *buffer, size_t capacity) const;
+    template <class It>
+    size_t render(It& first, It last, char *buffer, size_t capacity) const;
+    template <class It>
+    void write(It first, It last, std::ostream& out) const;
+
+private:
+    static std::locale find_locale(const char *locale_name);
+    char *put_amount(char *pos, float amount) const;
+    static char *put_chars(char *pos, const char *text, size_t n);
+    static char *put_padded(char *pos, unsigned int value, size_t width);
+    static char *put_repeat(char *pos, char c, size_t n);
+    template <class Node>
+    char *put_job(char *pos, const Node& job) const;
+
+    std::string currency; // symbol put before text amounts
+    char decimal_point;
+    std::string grouping; // numpunct grouping of the integer digits
+    job_report_layout layout;
+    size_t max_record; // upper bound on one rendered job
+    char separator; // field separator for CSV/TSV
+    char thousands_sep;
+};
+
+// --------- BEGIN Class Functions --------------
+
+/*
+Function Name: job_report
+Description:
+    Reads the number and currency format of a locale once.
+    An unknown locale name falls back to the classic "C"
+    locale rather than throwing.
+Input(s):
+    layout - job_report_layout. text, CSV or TSV.
+    locale_name - char pointer. locale to format with, ""
+                  for the user's environment locale.
+Return(s):
+    None
+*/
+inline job_report::job_report(job_report_layout layout, const char *locale_name) : job_report(layout, find_locale(locale_name)) {
+}
+
+/*
+Function Name: job_report
+Description:
+    Reads the number and currency format of a locale once.
+Input(s):
+    layout - job_report_layout. text, CSV or TSV.
+    loc - locale reference. locale to format with.
+Return(s):
+    None
+*/
+inline job_report::job_report(job_report_layout layout, const std::locale& loc) : layout(layout) {
+    const std::numpunct<char>& numbers = std::use_facet<std::numpunct<char> >(loc);
+    const std::moneypunct<char>& money = std::use_facet<std::moneypunct<char> >(loc);
+    decimal_point = numbers.decimal_point();
+    thousands_sep = numbers.thousands_sep();
+    grouping = numbers.grouping();
+    currency = money.curr_symbol();
+    separator = (layout == JOB_REPORT_TSV) ? '\t' : ',';
+
+    // 3 amounts of up to ~80 chars each (the 39 digits of FLT_MAX with a
+    // separator between every two), plus labels and rules
+    max_record = 384 + 3 * currency.size();
+}
+
+// --------- PRIVATE Class Functions --------------
+
+/*
+Function Name: find_locale
+Description:
+    Looks up a locale by name, falling back to the classic
+    "C" locale when the name is unknown.
+Input(s):
+    locale_name - char pointer. locale name, "" for the
+                  user's environment locale.
+Return(s):
+    loc - locale.
+*/
+inline std::locale job_report::find_locale(const char *locale_name) {
+    try {
+        return std::locale(locale_name);
+    } catch (const std::runtime_error&) {
+        return std::locale::classic();
+    }
+}
+
+/*
+Function Name: put_amount
+Description:
+    Writes an amount with two decimals. Text reports use
+    the locale's currency symbol, digit grouping and decimal
+    point (e.g. -$4,500.00); CSV/TSV write plain -4500.00.
+    An amount too large to count in cents (a float that
+    big has no fraction left) is written from its whole
+    digits, and NaN or infinity is written as n/a.
+Input(s):
+    pos - char pointer. where to write.
+    amount - float. amount to write.
+Return(s):
+    pos - char pointer. end of the written text.
+*/
+inline char *job_report::put_amount(char *pos, float amount) const {
+    bool text = (layout == JOB_REPORT_TEXT);
+    double scaled = (double)amount * 100.0;
+    if (!std::isfinite(scaled)) return put_chars(pos, "n/a", 3);
+
+    bool negative;
+    unsigned int fraction;
+    char digits[48];
+    size_t n;
+    if (std::fabs(scaled) < 9.0e18) {
+        long long cents = std::llround(scaled);
+        unsigned long long whole = (cents < 0) ? (unsigned long long)(-cents) : (unsigned long long)cents;
+        negative = (cents < 0);
+        fraction = (unsigned int)(whole % 100);
+        n = std::to_chars(digits, digits + sizeof(digits), whole / 100).ptr - digits;
+    } else {
+        // Past LLONG_MAX cents; up to 39 whole digits for FLT_MAX
+        negative = (amount < 0);
+        fraction = 0;
+        n = std::to_chars(digits, digits + sizeof(digits), std::fabs((double)amount), std::chars_format::fixed, 0).ptr - digits;
+    }
+
+    if (negative) *pos++ = '-';
+    if (text) pos = put_chars(pos, currency.data(), currency.size());
+
+    if (!text || grouping.empty() || (grouping[0] <= 0)) {
+        pos = put_chars(pos, digits, n);
+    } else {
+        // Walk the groups from the right, the last group size repeats
+        char grouped[96];
+        char *out = grouped + sizeof(grouped);
+        size_t g = 0;
+        int left = grouping[0];
+        for (size_t i = n; i > 0; i--) {
+            if (left == 0) {
+                *--out = thousands_sep;
+                if (g + 1 < grouping.size()) g++;
+                left = ((grouping[g] > 0) && (grouping[g] != CHAR_MAX)) ? grouping[g] : INT_MAX;
+            }
+            *--out = digits[i - 1];
+            left--;
+        }
+        pos = put_chars(pos, out, grouped + sizeof(grouped) - out);
+    }
+
+    *pos++ = text ? decimal_point : '.';
+    return put_padded(pos, fraction, 2);
+}
+
+/*
+Function Name: put_chars
+Description:
+    Copies n characters to pos.
+Input(s):
+    pos - char pointer. where to write.
+    text - char pointer. characters to copy.
+    n - size_t. number of characters.
+Return(s):
+    pos - char pointer. end of the written text.
+*/
+inline char *job_report::put_chars(char *pos, const char *text, size_t n) {
+    std::memcpy(pos, text, n);
+    return pos + n;
+}
+
+/*
+Function Name: put_padded
+Description:
+    Writes an unsigned number zero padded to a minimum width.
+Input(s):
+    pos - char pointer. where to write.
+    value - unsigned int. number to write.
+    width - size_t. minimum number of digits.
+Return(s):
+    pos - char pointer. end of the written text.
+*/
+inline char *job_report::put_padded(char *pos, unsigned int value, size_t width) {
+    char digits[16];
+    size_t n = std::to_chars(digits, digits + sizeof(digits), value).ptr - digits;
+    if (n < width) pos = put_repeat(pos, '0', width - n);
+    return put_chars(pos, digits, n);
+}
+
+/*
+Function Name: put_repeat
+Description:
+    Writes a character n times.
+Input(s):
+    pos - char pointer. where to write.
+    c - char. character to write.
+    n - size_t. number of times.
+Return(s):
+    pos - char pointer. end of the written text.
+*/
+inline char *job_report::put_repeat(char *pos, char c, size_t n) {
+    std::memset(pos, c, n);
+    return pos + n;
+}
+
+/*
+Function Name: put_job
+Description:
+    Formats one job in the report layout. The caller makes
+    sure max_record bytes are free at pos.
+Input(s):
+    pos - char pointer. where to write.
+    job - job tree node reference. job to write.
+Return(s):
+    pos - char pointer. end of the written record.
+*/
+template <class Node>
+char *job_report::put_job(char *pos, const Node& job) const {
+    float estimate = job.value.job_estimate;
+    float cost = job.value.job_cost;
+
+    if (layout == JOB_REPORT_TEXT) {
+        pos = put_chars(pos, "JOB: ", 5);
+        pos = put_padded(pos, job.key.year(), 2);
+        *pos++ = '-';
+        pos = put_padded(pos, job.key.job_number(), 3);
+        *pos++ = '\n';
+        pos = put_repeat(pos, '-', 14);
+        pos = put_chars(pos, "\n\tEstimate: ", 12);
+        pos = put_amount(pos, estimate);
+        pos = put_chars(pos, "\n\tCost: ", 8);
+        pos = put_amount(pos, cost);
+        pos = put_chars(pos, "\n\tProfit/Loss: ", 15);
+        pos = put_amount(pos, estimate - cost);
+        *pos++ = '\n';
+        pos = put_repeat(pos, '-', 40);
+        *pos++ = '\n';
+        return pos;
+    }
+
+    pos = put_padded(pos, job.key.year(), 1);
+    *pos++ = separator;
+    pos = put_padded(pos, job.key.job_number(), 1);
+    *pos++ = separator;
+    pos = put_amount(pos, estimate);
+    *pos++ = separator;
+    pos = put_amount(pos, cost);
+    *pos++ = separator;
+    pos = put_amount(pos, estimate - cost);
+    *pos++ = '\n';
+    return pos;
+}
+
+// --------- PUBLIC Class Functions --------------
+
+/*
+Function Name: header
+Description:
+    Writes the column header line of a CSV/TSV report.
+    Text reports have no header.
+Input(s):
+    buffer - char pointer. where to write.
+    capacity - size_t. size of the buffer in bytes.
+Return(s):
+    bytes - size_t. bytes written, 0 if none or no room.
+*/
+inline size_t job_report::header(char *buffer, size_t capacity) const {
+    if (layout == JOB_REPORT_TEXT) return 0;
+
+    const char *names[] = {"year", "job_number", "estimate", "cost", "profit_loss"};
+    std::string line;
+    for (int i = 0; i < 5; i++) {
+        if (i > 0) line += separator;
+        line += names[i];
+    }
+    line += '\n';
+    if (line.size() > capacity) return 0;
+    put_chars(buffer, line.data(), line.size());
+    return line.size();
+}
+
+/*
+Function Name: render
+Description:
+    Formats jobs from first into a caller supplied buffer
+    until the buffer is nearly full. first is left on the
+    first job not written, so calling again carries on; the
+    report is done once first == last. Pass iterators for
+    ascending order, reverse iterators for descending.
+Input(s):
+    first - iterator reference. first job to write.
+    last - iterator. one past the last job.
+    buffer - char pointer. where to write.
+    capacity - size_t. size of the buffer in bytes.
+Return(s):
+    bytes - size_t. bytes written.
+*/
+template <class It>
+size_t job_report::render(It& first, It last, char *buffer, size_t capacity) const {
+    char *pos = buffer;
+    char *end = buffer + capacity;
+    while ((first != last) && ((size_t)(end - pos) >= max_record)) {
+        pos = put_job(pos, *first);
+        ++first;
+    }
+    return pos - buffer;
+}
+
+/*
+Function Name: write
+Description:
+    Renders a whole report (header included) to a stream,
+    one write() per megabyte.
+Input(s):
+    first - iterator. first job to write.
+    last - iterator. one past the last job.
+    out - output stream reference. where the report goes.
+Return(s):
+    None
+*/
+template <class It>
+void job_report::write(It first, It last, std::ostream& out) const {
+    std::vector<char> buffer(std::max<size_t>(1 << 20, max_record));
+    size_t bytes = header(&buffer[0], buffer.size());
+    if (bytes > 0) out.write(&buffer[0], bytes);
+
+    while (first != last) {
+        bytes = render(first, last, &buffer[0], buffer.size());
+        out.write(&buffer[0], bytes);
+    }
+    out.flush();
+}
+
+// --------- END Class Functions --------------
+
+#endif
@@ -0,0 +1,455 @@
+/*
+Created By: Thomas Osgood
+
+Description:
+    Sharded job store. Jobs are split over several
+    independent job trees, each behind its own reader/writer
+    lock, so writers to different shards never wait on each
+    other and scans can run on every core.
+
+    Partitioning:
+        JOB_SHARD_YEAR - shard = year % shards. A year range
+                         shorter than the shard count only
+                         touches the shards that hold it.
+        JOB_SHARD_HASH - shard from a hash of the packed key,
+                         for feeds where one year dominates.
+
+    Point operations (new_job, delete_job, update_job,
+    search_job) lock and touch one shard. Range reports,
+    totals and the oldest/newest searches fan out over the
+    shards on a thread_pool, then merge the per-shard results
+    in key order.
+
+    Results are handed back as copies (job_snapshot_record)
+    rather than node pointers, since a node can be freed by
+    another thread as soon as its shard is unlocked.
+
+    To Use:
+    job_shards jobs(16, JOB_SHARD_YEAR);
+    jobs.new_job(21, 7, 18000, 22000);
+    job_summary totals = jobs.year_summary(20, 21);
+*/
+#ifndef JOB_SHARDS_H
+#define JOB_SHARDS_H
+
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+
+#include "job_report.h"
+#include "job_snapshot.h"
+#include "job_tree.h"
+#include "thread_pool.h"
+
+enum job_shard_mode { JOB_SHARD_YEAR, JOB_SHARD_HASH };
+
+/*
+    Define Job Shards Class
+*/
+class job_shards {
+
+public:
+    job_shards(unsigned int shards = 16, job_shard_mode mode = JOB_SHARD_YEAR, unsigned int threads = 0);
+    size_t collect(unsigned int first_year, unsigned int last_year, std::vector<job_snapshot_record>& jobs) const;
+    bool delete_job(unsigned int year, unsigned int jno);
+    bool new_job(unsigned int year, unsigned int job_number, float job_cost = 0.0, float job_estimate = 0.0);
+    void print_ascending(job_report_layout layout = JOB_REPORT_TEXT, std::ostream& out = std::cout) const;
+    void print_descending(job_report_layout layout = JOB_REPORT_TEXT, std::ostream& out = std::cout) const;
+    bool search_job(unsigned int year, unsigned int jno, job_data& data) const;
+    bool search_newest(job_snapshot_record& job) const;
+    bool search_oldest(job_snapshot_record& job) const;
+    size_t shard_count() const;
+    size_t size() const;
+    bool update_job(unsigned int year, unsigned int jno, float job_cost, float job_estimate);
+    job_summary year_summary(unsigned int first_year, unsigned int last_year) const;
+
+private:
+    /*
+        Create Structure For One Shard
+    */
+    struct shard {
+        job_tree jobs;
+        mutable std::shared_mutex lock; // shared for reads, unique for writes
+    };
+
+    job_shards(const job_shards&);
+    job_shards& operator=(const job_shards&);
+
+    void search_end(bool newest, job_snapshot_record& job, bool& found) const;
+    size_t shard_of(const job_key& key) const;
+    void shards_for(unsigned int first_year, unsigned int last_year, std::vector<size_t>& which) const;
+
+    job_shard_mode mode;
+    mutable thread_pool pool; // runs the fan-out queries
+    std::vector<std::unique_ptr<shard> > shards;
+};
+
+// --------- BEGIN Class Functions --------------
+
+/*
+Function Name: job_shards
+Description:
+    Creates an empty sharded store.
+Input(s):
+    shards - unsigned int. number of shards, at least 1.
+    mode - job_shard_mode. partition by year or by key hash.
+    threads - unsigned int. fan-out threads, 0 for one per core.
+Return(s):
+    None
+*/
+inline job_shards::job_shards(unsigned int shards, job_shard_mode mode, unsigned int threads) : mode(mode), pool(threads) {
+    if (shards == 0) shards = 1;
+    for (unsigned int i = 0; i < shards; i++) this->shards.push_back(std::unique_ptr<shard>(new shard()));
+}
+
+// --------- PRIVATE Class Functions --------------
+
+/*
+Function Name: search_end
+Description:
+    Finds the oldest or newest job over every shard. Each
+    shard's min or max is read in parallel, then the
+    smallest or largest of those is kept.
+Input(s):
+    newest - bool. true for the newest job, false for the oldest.
+    job - snapshot record reference. receives the job.
+    found - bool reference. set to false if the store is empty.
+Return(s):
+    None
+*/
+inline void job_shards::search_end(bool newest, job_snapshot_record& job, bool& found) const {
+    std::vector<job_snapshot_record> ends(shards.size());
+    std::vector<char> has(shards.size(), 0);
+    pool.run(shards.size(), [&](size_t i) {
+        std::shared_lock<std::shared_mutex> hold(shards[i]->lock);
+        const job_tree::node *leaf = newest ? shards[i]->jobs.max_node() : shards[i]->jobs.min_node();
+        if (leaf != NULL) {
+            ends[i].key = leaf->key;
+            ends[i].value = leaf->value;
+            has[i] = 1;
+        }
+    });
+
+    found = false;
+    for (size_t i = 0; i < shards.size(); i++) {
+        if (!has[i]) continue;
+        if (!found || (newest ? (job.key.packed < ends[i].key.packed) : (ends[i].key.packed < job.key.packed))) job = ends[i];
+        found = true;
+    }
+}
+
+/*
+Function Name: shard_of
+Description:
+    Picks the shard that owns a job.
+Input(s):
+    key - job key reference. job to route.
+Return(s):
+    shard - size_t. index into shards.
+*/
+inline size_t job_shards::shard_of(const job_key& key) const {
+    if (mode == JOB_SHARD_YEAR) return key.year() % shards.size();
+    uint64_t hash = key.packed * 0x9E3779B97F4A7C15ULL; // Fibonacci hashing
+    return (size_t)((hash >> 32) % shards.size());
+}
+
+/*
+Function Name: shards_for
+Description:
+    Lists the shards that can hold jobs from first_year
+    through last_year. By year that is only the shards of
+    those years when the range is shorter than the shard
+    count; by hash it is every shard.
+Input(s):
+    first_year - unsigned int. first year of the range.
+    last_year - unsigned int. last year of the range.
+    which - vector of size_t. receives the shard indexes.
+Return(s):
+    None
+*/
+inline void job_shards::shards_for(unsigned int first_year, unsigned int last_year, std::vector<size_t>& which) const {
+    which.clear();
+    if (last_year < first_year) return;
+    if ((mode == JOB_SHARD_YEAR) && ((uint64_t)last_year - first_year + 1 < shards.size())) {
+        for (uint64_t year = first_year; year <= last_year; year++) which.push_back(year % shards.size());
+        return;
+    }
+    for (size_t i = 0; i < shards.size(); i++) which.push_back(i);
+}
+
+// --------- PUBLIC Class Functions --------------
+
+/*
+Function Name: collect
+Description:
+    Copies every job from first_year through last_year in
+    key order. Each shard copies its slice in parallel under
+    a shared lock, then the sorted slices are merged with a
+    heap.
+Input(s):
+    first_year - unsigned int. first year to include.
+    last_year - unsigned int. last year to include.
+    jobs - vector of snapshot records. receives the jobs.
+Return(s):
+    found - size_t. jobs added.
+*/
+inline size_t job_shards::collect(unsigned int first_year, unsigned int last_year, std::vector<job_snapshot_record>& jobs) const {
+    std::vector<size_t> which;
+    shards_for(first_year, last_year, which);
+
+    std::vector<std::vector<job_snapshot_record> > slices(which.size());
+    pool.run(which.size(), [&](size_t i) {
+        shard& part = *shards[which[i]];
+        std::shared_lock<std::shared_mutex> hold(part.lock);
+        std::pair<job_tree::iterator, job_tree::iterator> range = part.jobs.year_range(first_year, last_year);
+        for (job_tree::iterator it = range.first; it != range.second; ++it) {
+            job_snapshot_record record = {it->key, it->value};
+            slices[i].push_back(record);
+        }
+    });
+
+    // k-way merge on (next key, slice)
+    typedef std::pair<uint64_t, size_t> head;
+    std::priority_queue<head, std::vector<head>, std::greater<head> > heads;
+    std::vector<size_t> next(slices.size(), 0);
+    size_t total = 0;
+    for (size_t i = 0; i < slices.size(); i++) {
+        total += slices[i].size();
+        if (!slices[i].empty()) heads.push(head(slices[i][0].key.packed, i));
+    }
+
+    jobs.reserve(jobs.size() + total);
+    while (!heads.empty()) {
+        size_t i = heads.top().second;
+        heads.pop();
+        jobs.push_back(slices[i][next[i]++]);
+        if (next[i] < slices[i].size()) heads.push(head(slices[i][next[i]].key.packed, i));
+    }
+    return total;
+}
+
+/*
+Function Name: delete_job
+Description:
+    Deletes a job from its shard.
+Input(s):
+    year - unsigned int. job year.
+    jno - unsigned int. job number.
+Return(s):
+    true - the job was deleted.
+    false - the job was not in the store.
+*/
+inline bool job_shards::delete_job(unsigned int year, unsigned int jno) {
+    job_key key = {year, jno};
+    shard& part = *shards[shard_of(key)];
+    std::unique_lock<std::shared_mutex> hold(part.lock);
+    return part.jobs.erase(key);
+}
+
+/*
+Function Name: new_job
+Description:
+    Inserts a new job into its shard.
+Input(s):
+    year - unsigned integer. job year.
+    job_number - unsigned integer. job number.
+    job_cost - float. actual cost of job.
+    job_estimate - float. estimated cost of job.
+Return(s):
+    true - the job was added.
+    false - the job already exists.
+*/
+inline bool job_shards::new_job(unsigned int year, unsigned int job_number, float job_cost, float job_estimate) {
+    job_key key = {year, job_number};
+    job_data data = {job_cost, job_estimate};
+    shard& part = *shards[shard_of(key)];
+    std::unique_lock<std::shared_mutex> hold(part.lock);
+    return part.jobs.insert_unique(key, data).second;
+}
+
+/*
+Function Name: print_ascending
+Description:
+    Displays every job from oldest to newest.
+Input(s):
+    layout - job_report_layout. text, CSV or TSV.
+    out - output stream reference. defaults to std::cout.
+Return(s):
+    None
+*/
+inline void job_shards::print_ascending(job_report_layout layout, std::ostream& out) const {
+    std::vector<job_snapshot_record> jobs;
+    if (collect(0, UINT_MAX, jobs) == 0) {
+        std::cout << "\033[31m[!] No Jobs To Display\033[0m" << std::endl;
+        return;
+    }
+    job_report report(layout);
+    report.write(jobs.begin(), jobs.end(), out);
+}
+
+/*
+Function Name: print_descending
+Description:
+    Displays every job from newest to oldest.
+Input(s):
+    layout - job_report_layout. text, CSV or TSV.
+    out - output stream reference. defaults to std::cout.
+Return(s):
+    None
+*/
+inline void job_shards::print_descending(job_report_layout layout, std::ostream& out) const {
+    std::vector<job_snapshot_record> jobs;
+    if (collect(0, UINT_MAX, jobs) == 0) {
+        std::cout << "\033[31m[!] No Jobs To Display\033[0m" << std::endl;
+        return;
+    }
+    job_report report(layout);
+    report.write(jobs.rbegin(), jobs.rend(), out);
+}
+
+/*
+Function Name: search_job
+Description:
+    Looks a job up in its shard.
+Input(s):
+    year - unsigned integer. job year.
+    jno - unsigned integer. job number.
+    data - job data reference. receives the cost and estimate.
+Return(s):
+    true - the job was found.
+    false - the job is not in the store.
+*/
+inline bool job_shards::search_job(unsigned int year, unsigned int jno, job_data& data) const {
+    job_key key = {year, jno};
+    const shard& part = *shards[shard_of(key)];
+    std::shared_lock<std::shared_mutex> hold(part.lock);
+    const job_tree::node *leaf = part.jobs.search(key);
+    if (leaf == NULL) return false;
+    data = leaf->value;
+    return true;
+}
+
+/*
+Function Name: search_newest
+Description:
+    Finds the newest (year & job num) job in the store.
+Input(s):
+    job - snapshot record reference. receives the job.
+Return(s):
+    true - found.
+    false - the store is empty.
+*/
+inline bool job_shards::search_newest(job_snapshot_record& job) const {
+    bool found = false;
+    search_end(true, job, found);
+    return found;
+}
+
+/*
+Function Name: search_oldest
+Description:
+    Finds the oldest (year & job num) job in the store.
+Input(s):
+    job - snapshot record reference. receives the job.
+Return(s):
+    true - found.
+    false - the store is empty.
+*/
+inline bool job_shards::search_oldest(job_snapshot_record& job) const {
+    bool found = false;
+    search_end(false, job, found);
+    return found;
+}
+
+/*
+Function Name: shard_count
+Description:
+    Gets the number of shards.
+Input(s):
+    None
+Return(s):
+    shards - size_t.
+*/
+inline size_t job_shards::shard_count() const {
+    return shards.size();
+}
+
+/*
+Function Name: size
+Description:
+    Counts the jobs in every shard. Each shard is read under
+    its own lock, so with concurrent writers the total is
+    not a single point in time.
+Input(s):
+    None
+Return(s):
+    count - size_t. number of jobs.
+*/
+inline size_t job_shards::size() const {
+    size_t total = 0;
+    for (size_t i = 0; i < shards.size(); i++) {
+        std::shared_lock<std::shared_mutex> hold(shards[i]->lock);
+        total += shards[i]->jobs.size();
+    }
+    return total;
+}
+
+/*
+Function Name: update_job
+Description:
+    Changes the cost and estimate of a job in its shard.
+Input(s):
+    year - unsigned int. job year.
+    jno - unsigned int. job number.
+    job_cost - float. new actual cost of job.
+    job_estimate - float. new estimated cost of job.
+Return(s):
+    true - the job was updated.
+    false - the job is not in the store.
+*/
+inline bool job_shards::update_job(unsigned int year, unsigned int jno, float job_cost, float job_estimate) {
+    job_key key = {year, jno};
+    shard& part = *shards[shard_of(key)];
+    std::unique_lock<std::shared_mutex> hold(part.lock);
+    if (part.jobs.search(key) == NULL) return false;
+    part.jobs.update_job(year, jno, job_cost, job_estimate);
+    return true;
+}
+
+/*
+Function Name: year_summary
+Description:
+    Totals every job from first_year through last_year.
+    Each shard answers from its subtree summaries in
+    O(log n), in parallel, and the totals are merged.
+Input(s):
+    first_year - unsigned integer. first year to include.
+    last_year - unsigned integer. last year to include.
+Return(s):
+    summary - job_summary. count 0 if there are no jobs.
+*/
+inline job_summary job_shards::year_summary(unsigned int first_year, unsigned int last_year) const {
+    std::vector<size_t> which;
+    shards_for(first_year, last_year, which);
+
+    std::vector<job_summary> parts(which.size());
+    pool.run(which.size(), [&](size_t i) {
+        std::shared_lock<std::shared_mutex> hold(shards[which[i]]->lock);
+        parts[i] = shards[which[i]]->jobs.year_summary(first_year, last_year);
+    });
+
+    job_summary total;
+    for (size_t i = 0; i < parts.size(); i++) btree_summary<job_key, job_data>::merge(total, parts[i]);
+    return total;
+}
+
+// --------- END Class Functions --------------
+
+#endif
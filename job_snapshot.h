@@ -0,0 +1,541 @@
+/*
+Created By: Thomas Osgood
+
+Description:
+    On-disk snapshot of a job_tree that is used straight
+    from a read-only mmap(), with no rebuild on startup.
+
+    File layout (native byte order):
+        header  - magic, version, job count, the offset of
+                  the job section and checksums. 128 bytes.
+        jobs    - every job in key order, 16 bytes each
+                  (packed key, cost, estimate).
+
+    Nothing in the file is a pointer. The only position is
+    the job section offset in the header, so the file works
+    at whatever address it is mapped. Jobs are sorted, so a
+    search is a binary search over the mapping, the oldest
+    and newest jobs are the first and last records, and a
+    range scan is a contiguous slice.
+
+    The header has its own checksum and the job section has
+    another. open_mapped() checks both by default; pass
+    verify = false to skip the section checksum (one pass
+    over the file) when startup time matters most.
+
+    To Use:
+    job_snapshot::save(jobs, "jobs.snap");
+    job_snapshot snap;
+    if (snap.open_mapped("jobs.snap")) snap.search_job(21, 7);
+*/
+#ifndef JOB_SNAPSHOT_H
+#define JOB_SNAPSHOT_H
+
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "job_tree.h"
+
+/*
+    Create Structure For Snapshot Records
+
+    One job as stored in the file. Laid out like a tree
+    node's key and value, so code written against ->key and
+    ->value (e.g. job_report) reads mapped jobs as well.
+*/
+struct job_snapshot_record {
+    job_key key;
+    job_data value;
+};
+
+static_assert(sizeof(job_snapshot_record) == 16, "snapshot records must be 16 bytes");
+
+/*
+    Create Structure For Snapshot Header
+*/
+struct job_snapshot_header {
+    char magic[8]; // "JOBSNAP"
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t count; // number of jobs
+    uint64_t jobs_offset; // file offset of the job section
+    uint64_t file_size;
+    uint64_t jobs_checksum;
+    uint64_t header_checksum; // covers every field above
+    char reserved[72];
+};
+
+static_assert(sizeof(job_snapshot_header) == 128, "snapshot header must be 128 bytes");
+
+/*
+    Define Job Snapshot Class
+*/
+class job_snapshot {
+
+public:
+    typedef const job_snapshot_record *iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+
+    job_snapshot();
+    ~job_snapshot();
+
+    iterator begin() const;
+    static uint64_t checksum(const void *data, size_t bytes, uint64_t hash = 14695981039346656037ULL);
+    void close();
+    bool empty() const;
+    iterator end() const;
+    iterator lower_bound(const job_key& key) const;
+    bool open_mapped(const char *path, bool verify = true);
+    reverse_iterator rbegin() const;
+    reverse_iterator rend() const;
+    static bool save(const job_tree& jobs, const char *path);
+    const job_snapshot_record *search_job(unsigned int year, unsigned int jno) const;
+    const job_snapshot_record *search_newest() const;
+    const job_snapshot_record *search_oldest() const;
+    size_t size() const;
+    static bool sync_directory(const char *path);
+    iterator upper_bound(const job_key& key) const;
+    std::pair<iterator, iterator> year_range(unsigned int first_year, unsigned int last_year) const;
+    static bool write_all(int fd, const void *data, size_t bytes);
+
+private:
+    size_t count;
+    const job_snapshot_record *jobs;
+    void *mapping;
+    size_t mapping_size;
+
+    job_snapshot(const job_snapshot&);
+    job_snapshot& operator=(const job_snapshot&);
+};
+
+// --------- BEGIN Class Functions --------------
+
+/*
+Function Name: job_snapshot
+Description:
+    Creates an empty snapshot with nothing mapped.
+Input(s):
+    None
+Return(s):
+    None
+*/
+inline job_snapshot::job_snapshot() : count(0), jobs(NULL), mapping(NULL), mapping_size(0) {
+}
+
+/*
+Function Name: ~job_snapshot
+Description:
+    Unmaps the snapshot file, if one is open.
+Input(s):
+    None
+Return(s):
+    None
+*/
+inline job_snapshot::~job_snapshot() {
+    close();
+}
+
+// --------- PUBLIC Class Functions --------------
+
+/*
+Function Name: begin
+Description:
+    Gets the oldest job, or end() when nothing is mapped.
+Input(s):
+    None
+Return(s):
+    iterator - pointer to the first record.
+*/
+inline job_snapshot::iterator job_snapshot::begin() const {
+    return jobs;
+}
+
+/*
+Function Name: checksum
+Description:
+    64 bit FNV-1a style checksum, folded a word at a time
+    instead of a byte at a time. Can be chained by passing
+    the previous result as hash.
+Input(s):
+    data - pointer. bytes to check.
+    bytes - size_t. number of bytes.
+    hash - uint64_t. running checksum to continue.
+Return(s):
+    hash - uint64_t. checksum of the bytes.
+*/
+inline uint64_t job_snapshot::checksum(const void *data, size_t bytes, uint64_t hash) {
+    const unsigned char *pos = static_cast<const unsigned char *>(data);
+    for (; bytes >= 8; bytes -= 8, pos += 8) {
+        uint64_t word;
+        std::memcpy(&word, pos, 8);
+        hash = (hash ^ word) * 1099511628211ULL;
+    }
+    for (; bytes > 0; bytes--, pos++) hash = (hash ^ *pos) * 1099511628211ULL;
+    return hash;
+}
+
+/*
+Function Name: close
+Description:
+    Unmaps the snapshot file. Pointers into it become invalid.
+Input(s):
+    None
+Return(s):
+    None
+*/
+inline void job_snapshot::close() {
+    if (mapping != NULL) munmap(mapping, mapping_size);
+    mapping = NULL;
+    mapping_size = 0;
+    jobs = NULL;
+    count = 0;
+}
+
+/*
+Function Name: empty
+Description:
+    Checks whether the snapshot has any jobs.
+Input(s):
+    None
+Return(s):
+    true - no jobs (or nothing mapped).
+    false - at least one job.
+*/
+inline bool job_snapshot::empty() const {
+    return count == 0;
+}
+
+/*
+Function Name: end
+Description:
+    Gets the position one past the newest job.
+Input(s):
+    None
+Return(s):
+    iterator - pointer past the last record.
+*/
+inline job_snapshot::iterator job_snapshot::end() const {
+    return jobs + count;
+}
+
+/*
+Function Name: lower_bound
+Description:
+    Finds the first job whose key is not less than key.
+    Branch-free binary search: one compare per step and
+    no early exit, so each step's load can start before
+    the previous compare is known.
+Input(s):
+    key - job key reference. key to look for.
+Return(s):
+    iterator - first job >= key, end() if there is none.
+*/
+inline job_snapshot::iterator job_snapshot::lower_bound(const job_key& key) const {
+    if (count == 0) return end();
+    const job_snapshot_record *base = jobs;
+    size_t n = count;
+    while (n > 1) {
+        size_t half = n / 2;
+        base = (base[half - 1].key.packed < key.packed) ? base + half : base;
+        n -= half;
+    }
+    return (base->key.packed < key.packed) ? base + 1 : base;
+}
+
+/*
+Function Name: open_mapped
+Description:
+    Maps a snapshot file read-only and checks it. Any file
+    already open is closed first.
+Input(s):
+    path - char pointer. snapshot file to open.
+    verify - bool. also checksum the job section (reads
+             the whole file once). The header is always
+             checked.
+Return(s):
+    true - the snapshot is mapped and valid.
+    false - the file could not be opened or is not a
+            valid snapshot.
+*/
+inline bool job_snapshot::open_mapped(const char *path, bool verify) {
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if ((fstat(fd, &info) != 0) || ((size_t)info.st_size < sizeof(job_snapshot_header))) {
+        ::close(fd);
+        return false;
+    }
+
+    size_t file_size = info.st_size;
+    void *map = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return false;
+
+    const job_snapshot_header *header = static_cast<const job_snapshot_header *>(map);
+    bool valid = (std::memcmp(header->magic, "JOBSNAP", 8) == 0) &&
+        (header->version == 1) &&
+        (header->record_size == sizeof(job_snapshot_record)) &&
+        (header->header_checksum == checksum(header, offsetof(job_snapshot_header, header_checksum))) &&
+        (header->file_size == file_size) &&
+        (header->jobs_offset >= sizeof(job_snapshot_header)) &&
+        (header->jobs_offset <= file_size) &&
+        (header->jobs_offset % alignof(job_snapshot_record) == 0) &&
+        (header->count <= (file_size - header->jobs_offset) / sizeof(job_snapshot_record));
+
+    const job_snapshot_record *records = NULL;
+    if (valid) {
+        records = reinterpret_cast<const job_snapshot_record *>(static_cast<const char *>(map) + header->jobs_offset);
+        if (verify) valid = (checksum(records, header->count * sizeof(job_snapshot_record)) == header->jobs_checksum);
+    }
+    if (!valid) {
+        munmap(map, file_size);
+        return false;
+    }
+
+    mapping = map;
+    mapping_size = file_size;
+    jobs = records;
+    count = header->count;
+    return true;
+}
+
+/*
+Function Name: rbegin
+Description:
+    Gets the newest job, for walking newest to oldest.
+Input(s):
+    None
+Return(s):
+    reverse_iterator - reverse iterator at the newest job.
+*/
+inline job_snapshot::reverse_iterator job_snapshot::rbegin() const {
+    return reverse_iterator(end());
+}
+
+/*
+Function Name: rend
+Description:
+    Gets the position before the oldest job.
+Input(s):
+    None
+Return(s):
+    reverse_iterator - one past the oldest job, backwards.
+*/
+inline job_snapshot::reverse_iterator job_snapshot::rend() const {
+    return reverse_iterator(begin());
+}
+
+/*
+Function Name: save
+Description:
+    Writes every job of a tree to a snapshot file. The file
+    is written under a temporary name, synced and renamed
+    into place, so readers never see a half written file.
+    The directory is synced after the rename so the new
+    name survives a crash as well.
+Input(s):
+    jobs - job tree reference. jobs to save.
+    path - char pointer. snapshot file to create/replace.
+Return(s):
+    true - the snapshot was written.
+    false - the file could not be written.
+*/
+inline bool job_snapshot::save(const job_tree& jobs, const char *path) {
+    std::string temp = std::string(path) + ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+
+    job_snapshot_header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "JOBSNAP", 8);
+    header.version = 1;
+    header.record_size = sizeof(job_snapshot_record);
+    header.count = jobs.size();
+    header.jobs_offset = sizeof(job_snapshot_header);
+    header.file_size = header.jobs_offset + header.count * sizeof(job_snapshot_record);
+    header.jobs_checksum = checksum(NULL, 0);
+
+    // Header goes in last, once the job checksum is known
+    bool ok = (lseek(fd, header.jobs_offset, SEEK_SET) == (off_t)header.jobs_offset);
+
+    std::vector<job_snapshot_record> buffer;
+    buffer.reserve(65536);
+    job_tree::iterator it = jobs.begin();
+    while (ok && (it != jobs.end())) {
+        buffer.clear();
+        for (; (it != jobs.end()) && (buffer.size() < 65536); ++it) {
+            job_snapshot_record record;
+            record.key = it->key;
+            record.value = it->value;
+            buffer.push_back(record);
+        }
+        size_t bytes = buffer.size() * sizeof(job_snapshot_record);
+        header.jobs_checksum = checksum(&buffer[0], bytes, header.jobs_checksum);
+        ok = write_all(fd, &buffer[0], bytes);
+    }
+
+    header.header_checksum = checksum(&header, offsetof(job_snapshot_header, header_checksum));
+    ok = ok && (lseek(fd, 0, SEEK_SET) == 0) && write_all(fd, &header, sizeof(header));
+    ok = ok && (fsync(fd) == 0);
+    ok = (::close(fd) == 0) && ok;
+    ok = ok && (std::rename(temp.c_str(), path) == 0);
+    if (!ok) unlink(temp.c_str());
+    return ok && sync_directory(path);
+}
+
+/*
+Function Name: search_job
+Description:
+    Searches the mapped jobs for a job.
+Input(s):
+    year - unsigned integer. job year.
+    jno - unsigned integer. job number.
+Return(s):
+    record - pointer to the job in the mapping.
+    NULL - job does not exist in the snapshot.
+*/
+inline const job_snapshot_record *job_snapshot::search_job(unsigned int year, unsigned int jno) const {
+    job_key key(year, jno);
+    iterator it = lower_bound(key);
+    if ((it != end()) && (it->key.packed == key.packed)) return it;
+    return NULL;
+}
+
+/*
+Function Name: search_newest
+Description:
+    Gets the newest job in the snapshot.
+Input(s):
+    None
+Return(s):
+    record - pointer to the newest job, NULL when empty.
+*/
+inline const job_snapshot_record *job_snapshot::search_newest() const {
+    return (count > 0) ? jobs + count - 1 : NULL;
+}
+
+/*
+Function Name: search_oldest
+Description:
+    Gets the oldest job in the snapshot.
+Input(s):
+    None
+Return(s):
+    record - pointer to the oldest job, NULL when empty.
+*/
+inline const job_snapshot_record *job_snapshot::search_oldest() const {
+    return (count > 0) ? jobs : NULL;
+}
+
+/*
+Function Name: size
+Description:
+    Gets the number of jobs in the snapshot.
+Input(s):
+    None
+Return(s):
+    count - size_t. number of jobs.
+*/
+inline size_t job_snapshot::size() const {
+    return count;
+}
+
+/*
+Function Name: sync_directory
+Description:
+    Syncs the directory holding a file, so a file that was
+    just created or renamed there is still found under its
+    name after a crash.
+Input(s):
+    path - char pointer. file whose directory to sync.
+Return(s):
+    true - the directory entry is on disk.
+    false - the directory could not be opened or synced.
+*/
+inline bool job_snapshot::sync_directory(const char *path) {
+    std::string dir(path);
+    size_t slash = dir.find_last_of('/');
+    if (slash == std::string::npos) dir = ".";
+    else dir.erase((slash > 0) ? slash : 1);
+
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return false;
+    bool ok = (fsync(fd) == 0);
+    return (::close(fd) == 0) && ok;
+}
+
+/*
+Function Name: upper_bound
+Description:
+    Finds the first job whose key is greater than key.
+Input(s):
+    key - job key reference. key to look past.
+Return(s):
+    iterator - first job > key, end() if there is none.
+*/
+inline job_snapshot::iterator job_snapshot::upper_bound(const job_key& key) const {
+    if (key.packed == UINT64_MAX) return end();
+    job_key next;
+    next.packed = key.packed + 1;
+    return lower_bound(next);
+}
+
+/*
+Function Name: year_range
+Description:
+    Gets every job from first_year through last_year as a
+    contiguous slice of the mapping, in ascending order.
+Input(s):
+    first_year - unsigned integer. first year to include.
+    last_year - unsigned integer. last year to include.
+Return(s):
+    (first, last) - pointers bounding the jobs.
+*/
+inline std::pair<job_snapshot::iterator, job_snapshot::iterator> job_snapshot::year_range(unsigned int first_year, unsigned int last_year) const {
+    return std::make_pair(lower_bound(job_key(first_year, 0)), upper_bound(job_key(last_year, UINT_MAX)));
+}
+
+/*
+Function Name: write_all
+Description:
+    write() that retries short writes and EINTR.
+Input(s):
+    fd - int. file to write to.
+    data - pointer. bytes to write.
+    bytes - size_t. number of bytes.
+Return(s):
+    true - everything was written.
+    false - write() failed.
+*/
+inline bool job_snapshot::write_all(int fd, const void *data, size_t bytes) {
+    const char *pos = static_cast<const char *>(data);
+    while (bytes > 0) {
+        ssize_t written = ::write(fd, pos, bytes);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        pos += written;
+        bytes -= written;
+    }
+    return true;
+}
+
+// --------- END Class Functions --------------
+
+#endif
@@ -0,0 +1,1049 @@
+/*
+Created By: Thomas Osgood
+
+Description:
+    Job tree used by job_sorter.cpp. Jobs are ordered by
+    year, then job number, on top of the generic btree.
+    Every node also carries a job_summary of its subtree so
+    cost, estimate and profit totals over any key range
+    come from aggregate() in O(log n).
+
+    split(), join() and erase_range() cut and splice whole
+    subtrees in O(log n); purge_before() uses them for
+    retention. merge(), intersect() and difference() combine
+    two trees in O(m log(n / m + 1)), optionally across a
+    thread_pool.
+
+    Optional secondary indexes on profit and on cost
+    (enable_index) answer top-K and threshold queries in
+    O(log n + k). The btree base is protected and only its
+    read-only functions are public, so jobs can only go in
+    and out through the job_tree functions (new_job,
+    delete_job, update_job, insert_unique, erase,
+    erase_range, split, join, merge, intersect, difference,
+    build_from), which keep the indexes in step.
+*/
+#ifndef JOB_TREE_H
+#define JOB_TREE_H
+
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "btree.h"
+#include "job_report.h"
+
+/*
+    Define Job Key
+
+    Year and job number packed into one 64 bit value,
+    (year << 32) | job_number, so ordering by year then job
+    number is a single integer compare at every tree level.
+*/
+struct job_key {
+    job_key() : packed(0) {}
+    job_key(unsigned int year, unsigned int job_number) : packed((uint64_t(year) << 32) | job_number) {}
+
+    unsigned int year() const { return (unsigned int)(packed >> 32); }
+    unsigned int job_number() const { return (unsigned int)packed; }
+
+    uint64_t packed;
+};
+
+struct job_data {
+    float job_cost;
+    float job_estimate;
+};
+
+struct job_record {
+    unsigned int year;
+    unsigned int job_number;
+    float job_cost;
+    float job_estimate;
+};
+
+/*
+    Define Job Key Compare
+
+    Orders jobs by year, then job number, by comparing the
+    packed keys.
+*/
+struct job_key_less {
+    bool operator()(const job_key& a, const job_key& b) const {
+        return a.packed < b.packed;
+    }
+};
+
+// job keys compare in one instruction, search them branch-light
+template <>
+struct btree_fast_compare<job_key, job_key_less> : std::true_type {};
+
+/*
+    Define Job Summary
+
+    Totals over a set of jobs, kept for every subtree of a
+    job tree so job_tree::aggregate() can total any key range
+    without visiting each job. Sums are doubles so millions
+    of float amounts add up without drifting. Profit is
+    estimate minus cost, as in the job report.
+*/
+struct job_summary {
+    job_summary() : count(0), total_cost(0.0), total_estimate(0.0),
+        min_profit(std::numeric_limits<float>::infinity()), max_profit(-std::numeric_limits<float>::infinity()) {}
+
+    double profit() const { return total_estimate - total_cost; }
+
+    size_t count;
+    double total_cost;
+    double total_estimate;
+    float min_profit;
+    float max_profit;
+};
+
+template <>
+struct btree_summary<job_key, job_data> {
+    typedef job_summary type;
+
+    static type of(const job_key&, const job_data& data) {
+        type one;
+        one.count = 1;
+        one.total_cost = data.job_cost;
+        one.total_estimate = data.job_estimate;
+        one.min_profit = one.max_profit = data.job_estimate - data.job_cost;
+        return one;
+    }
+
+    static void merge(type& into, const type& other) {
+        into.count += other.count;
+        into.total_cost += other.total_cost;
+        into.total_estimate += other.total_estimate;
+        if (other.min_profit < into.min_profit) into.min_profit = other.min_profit;
+        if (other.max_profit > into.max_profit) into.max_profit = other.max_profit;
+    }
+};
+
+/*
+Function Name: btree_to_chars
+Description:
+    Export text for a job key: year, a dash, then the job
+    number padded to three digits (e.g. 19-007).
+Input(s):
+    first - char pointer. where to start writing.
+    last - char pointer. end of the space available.
+    key - job key reference. key to write.
+Return(s):
+    end - char pointer. end of the text, NULL if no room.
+*/
+inline char *btree_to_chars(char *first, char *last, const job_key& key) {
+    first = btree_to_chars(first, last, key.year());
+    if ((first == NULL) || (first == last)) return NULL;
+    *first++ = '-';
+
+    char digits[16];
+    size_t n = std::to_chars(digits, digits + sizeof(digits), key.job_number()).ptr - digits;
+    size_t pad = (n < 3) ? 3 - n : 0;
+    if ((size_t)(last - first) < pad + n) return NULL;
+    std::memset(first, '0', pad);
+    std::memcpy(first + pad, digits, n);
+    return first + pad + n;
+}
+
+/*
+Function Name: btree_to_chars
+Description:
+    Export text for job data: cost, a space, then estimate.
+Input(s):
+    first - char pointer. where to start writing.
+    last - char pointer. end of the space available.
+    data - job data reference. data to write.
+Return(s):
+    end - char pointer. end of the text, NULL if no room.
+*/
+inline char *btree_to_chars(char *first, char *last, const job_data& data) {
+    first = btree_to_chars(first, last, data.job_cost);
+    if ((first == NULL) || (first == last)) return NULL;
+    *first++ = ' ';
+    return btree_to_chars(first, last, data.job_estimate);
+}
+
+/*
+    Define Job Index Types
+
+    A secondary index orders jobs by one float field (profit
+    or cost), breaking ties by job key so every entry is
+    unique. Each entry maps to the job's node in the primary
+    tree, which never moves while the job is in the tree, so
+    index queries hand back jobs without a second search.
+*/
+enum job_index_field { JOB_INDEX_PROFIT, JOB_INDEX_COST, JOB_INDEX_FIELDS };
+
+struct job_index_key {
+    float metric; // estimate - cost, or cost
+    job_key job;
+};
+
+struct job_index_less {
+    bool operator()(const job_index_key& a, const job_index_key& b) const {
+        if (a.metric < b.metric) return true;
+        if (b.metric < a.metric) return false;
+        return a.job.packed < b.job.packed;
+    }
+};
+
+typedef btree<job_index_key, btree_node<job_key, job_data> *, job_index_less> job_index;
+
+class job_tree : protected btree<job_key, job_data, job_key_less> {
+
+public:
+    // Read-only part of the btree; every mutation goes through job_tree
+    using btree::iterator;
+    using btree::item_type;
+    using btree::node;
+    using btree::reverse_iterator;
+    using btree::summary_type;
+
+    using btree::aggregate;
+    using btree::begin;
+    using btree::count_range;
+    using btree::display_tree;
+    using btree::display_tree_rev;
+    using btree::empty;
+    using btree::end;
+    using btree::equal_range;
+    using btree::export_to;
+    using btree::freeze;
+    using btree::height;
+    using btree::lower_bound;
+    using btree::maxKey;
+    using btree::max_node;
+    using btree::memory_usage;
+    using btree::minKey;
+    using btree::min_node;
+    using btree::parallel_for_each;
+    using btree::parallel_reduce;
+    using btree::rank;
+    using btree::rbegin;
+    using btree::reclaim;
+    using btree::rend;
+    using btree::search;
+    using btree::select;
+    using btree::size;
+    using btree::upper_bound;
+    using btree::validate;
+
+    job_tree(bool balance = true, size_t chunk_nodes = 4096);
+    template <class InputIt>
+    size_t build_from(InputIt first, InputIt last);
+    template <class InputIt>
+    size_t build_from_items(InputIt first, InputIt last);
+    bool delete_job(unsigned int year, unsigned int jno);
+    size_t delete_jobs(const std::vector<job_key>& batch);
+    void destroy_tree();
+    void difference(job_tree& other, thread_pool *pool = NULL);
+    void disable_index(job_index_field field);
+    void enable_index(job_index_field field);
+    bool erase(const job_key& key);
+    size_t erase_range(const job_key& lo, const job_key& hi);
+    const job_index *index(job_index_field field) const;
+    size_t index_range(job_index_field field, float lo, float hi, std::vector<node *>& jobs) const;
+    size_t index_top(job_index_field field, size_t k, bool largest, std::vector<node *>& jobs) const;
+    std::pair<node *, bool> insert_unique(const job_key& key, const job_data& data);
+    void intersect(job_tree& other, thread_pool *pool = NULL);
+    bool join(job_tree& right);
+    void merge(job_tree& other, thread_pool *pool = NULL);
+    void new_job(unsigned int year, unsigned int job_number, float job_cost = 0.0, float job_estimate = 0.0);
+    void print_ascending(job_report_layout layout = JOB_REPORT_TEXT, std::ostream& out = std::cout);
+    void print_descending(job_report_layout layout = JOB_REPORT_TEXT, std::ostream& out = std::cout);
+    std::vector<size_t> profit_histogram(float lo, float width, size_t bins, thread_pool *pool = NULL) const;
+    size_t purge_before(unsigned int first_year);
+    void rebuild_indexes();
+    node* search_job(unsigned int year, unsigned int jno);
+    node* search_newest();
+    node* search_oldest();
+    void split(const job_key& key, job_tree& right);
+    void update_job(unsigned int year, unsigned int jno, float job_cost, float job_estimate);
+    std::pair<iterator, iterator> year_range(unsigned int first_year, unsigned int last_year);
+    job_summary year_summary(unsigned int first_year, unsigned int last_year) const;
+
+private:
+    bool has_indexes() const;
+    void index_erase(const node *leaf);
+    void index_insert(node *leaf);
+    static job_index_key index_key(job_index_field field, const node *leaf);
+
+    std::unique_ptr<job_index> indexes[JOB_INDEX_FIELDS]; // NULL while disabled
+};
+
+// --------- BEGIN Class Functions --------------
+
+/*
+Function Name: job_tree
+Description:
+    Job tree function that will be called when the tree
+    is allocated/created.
+Input(s):
+    balance - bool. keep the tree AVL balanced on insert
+              and delete. pass false for the plain tree.
+    chunk_nodes - size_t. nodes allocated per pool chunk.
+Return(s):
+    None
+*/
+inline job_tree::job_tree(bool balance, size_t chunk_nodes) : btree(balance, node_pool<job_key>(chunk_nodes)) {
+}
+
+// --------- PRIVATE Class Functions --------------
+
+/*
+Function Name: has_indexes
+Description:
+    Checks whether any secondary index is enabled.
+Input(s):
+    None
+Return(s):
+    true - at least one index is kept.
+*/
+inline bool job_tree::has_indexes() const {
+    for (int field = 0; field < JOB_INDEX_FIELDS; field++) {
+        if (indexes[field]) return true;
+    }
+    return false;
+}
+
+/*
+Function Name: index_erase
+Description:
+    Removes a job from every enabled secondary index. Must
+    be called while the node still holds the indexed values.
+Input(s):
+    leaf - node pointer. job leaving the tree or changing.
+Return(s):
+    None
+*/
+inline void job_tree::index_erase(const node *leaf) {
+    for (int field = 0; field < JOB_INDEX_FIELDS; field++) {
+        if (indexes[field]) indexes[field]->erase(index_key((job_index_field)field, leaf));
+    }
+}
+
+/*
+Function Name: index_insert
+Description:
+    Adds a job to every enabled secondary index.
+Input(s):
+    leaf - node pointer. job in the primary tree.
+Return(s):
+    None
+*/
+inline void job_tree::index_insert(node *leaf) {
+    for (int field = 0; field < JOB_INDEX_FIELDS; field++) {
+        if (indexes[field]) indexes[field]->insert_unique(index_key((job_index_field)field, leaf), leaf);
+    }
+}
+
+/*
+Function Name: index_key
+Description:
+    Builds the secondary index key of a job.
+Input(s):
+    field - job_index_field. which index.
+    leaf - node pointer. job in the primary tree.
+Return(s):
+    key - job_index_key. (profit or cost, job key).
+*/
+inline job_index_key job_tree::index_key(job_index_field field, const node *leaf) {
+    float metric = leaf->value.job_cost;
+    if (field == JOB_INDEX_PROFIT) metric = leaf->value.job_estimate - leaf->value.job_cost;
+    job_index_key key = {metric, leaf->key};
+    return key;
+}
+
+// --------- PUBLIC Class Functions --------------
+
+/*
+Function Name: build_from
+Description:
+    Public BTREE function to replace the contents of the
+    tree with a range of job records.
+
+    Duplicate jobs are dropped (the first one is kept)
+    without printing a warning for each one.
+Input(s):
+    first - input iterator. first job record of the range.
+    last - input iterator. one past the last job record.
+Return(s):
+    dups - size_t. number of duplicate jobs dropped.
+*/
+template <class InputIt>
+size_t job_tree::build_from(InputIt first, InputIt last) {
+    std::vector<item_type> items;
+    for (; first != last; ++first) {
+        job_key key = {first->year, first->job_number};
+        job_data data = {first->job_cost, first->job_estimate};
+        items.push_back(item_type(key, data));
+    }
+    size_t dups = btree::build_from(items.begin(), items.end(), true);
+    rebuild_indexes();
+    return dups;
+}
+
+/*
+Function Name: build_from_items
+Description:
+    Public BTREE function to replace the contents of the
+    tree with a range of (key, data) items, in linear time
+    when they are sorted already. Every node held before
+    is freed, so pointers to old jobs are invalidated.
+
+    Duplicate jobs are dropped (the first one is kept).
+Input(s):
+    first - input iterator. first item of the range.
+    last - input iterator. one past the last item.
+Return(s):
+    dups - size_t. number of duplicate jobs dropped.
+*/
+template <class InputIt>
+size_t job_tree::build_from_items(InputIt first, InputIt last) {
+    size_t dups = btree::build_from(first, last, true);
+    rebuild_indexes();
+    return dups;
+}
+
+/*
+Function Name: delete_job
+Description:
+    Public BTREE function to delete a job node, in one
+    walk down the tree and one rebalancing walk back up.
+Input(s):
+    year - unsigned int. job year.
+    jno - unsigned int. job number.
+Return(s):
+    true - the job was deleted.
+    false - the job was not in the tree.
+*/
+inline bool job_tree::delete_job(unsigned int year, unsigned int jno) {
+    if (empty()) {
+        std::cout << "[*] Tree Empty. Nothing To Delete." << std::endl;
+        return false;
+    }
+
+    job_key key = {year, jno};
+    if (!erase(key)) {
+        std::cout << "\033[31mJob: " << year << "-";
+        std::cout << std::setfill('0') << std::setw(3) << jno;
+        std::cout << " Not Found.\033[0m" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+Function Name: delete_jobs
+Description:
+    Public BTREE function to delete a batch of jobs, e.g.
+    for nightly cleanup. The batch is sorted and removed in
+    one merged walk of the tree when it is large (see
+    btree::erase_sorted), one search per job when it is
+    small. Jobs that are not in the tree are skipped
+    without a warning.
+Input(s):
+    batch - vector of job keys. jobs to delete, any order,
+            repeats allowed.
+Return(s):
+    removed - size_t. jobs deleted.
+*/
+inline size_t job_tree::delete_jobs(const std::vector<job_key>& batch) {
+    std::vector<job_key> keys(batch);
+    std::sort(keys.begin(), keys.end(), job_key_less());
+    keys.erase(std::unique(keys.begin(), keys.end(), [](const job_key& a, const job_key& b) { return a.packed == b.packed; }), keys.end());
+    return erase_sorted(keys, [this](node *leaf) { index_erase(leaf); });
+}
+
+/*
+Function Name: destroy_tree
+Description:
+    Frees every job, emptying the secondary indexes too.
+Input(s):
+    None
+Return(s):
+    None
+*/
+inline void job_tree::destroy_tree() {
+    btree::destroy_tree();
+    for (int field = 0; field < JOB_INDEX_FIELDS; field++) {
+        if (indexes[field]) indexes[field]->destroy_tree();
+    }
+}
+
+/*
+Function Name: difference
+Description:
+    Removes every job whose key is also in another tree
+    (see btree::difference). other is left empty. With
+    secondary indexes enabled here, the removed jobs leave
+    them.
+Input(s):
+    other - job tree reference. jobs to remove. left empty.
+    pool - thread_pool pointer. NULL to run on this thread.
+Return(s):
+    None
+*/
+inline void job_tree::difference(job_tree& other, thread_pool *pool) {
+    if (&other == this) return;
+
+    if (has_indexes()) {
+        for (iterator it = other.begin(); it != other.end(); ++it) {
+            node *leaf = search(it->key);
+            if (leaf) index_erase(leaf);
+        }
+    }
+    for (int field = 0; field < JOB_INDEX_FIELDS; field++) {
+        if (other.indexes[field]) other.indexes[field]->destroy_tree();
+    }
+    btree::difference(other, pool);
+}
+
+/*
+Function Name: disable_index
+Description:
+    Drops a secondary index and stops maintaining it.
+Input(s):
+    field - job_index_field. which index.
+Return(s):
+    None
+*/
+inline void job_tree::disable_index(job_index_field field) {
+    indexes[field].reset();
+}
+
+/*
+Function Name: enable_index
+Description:
+    Builds a secondary index over the jobs already in the
+    tree (one sort, then a linear build) and keeps it in
+    step with every later insert, delete and update.
+Input(s):
+    field - job_index_field. which index.
+Return(s):
+    None
+*/
+inline void job_tree::enable_index(job_index_field field) {
+    if (!indexes[field]) indexes[field].reset(new job_index());
+
+    std::vector<job_index::item_type> items;
+    items.reserve(size());
+    for (iterator it = begin(); it != end(); ++it) items.push_back(job_index::item_type(index_key(field, it.get()), it.get()));
+    indexes[field]->build_from(items.begin(), items.end(), true);
+}
+
+/*
+Function Name: erase
+Description:
+    Removes a job from the tree and from the secondary
+    indexes, without printing anything. The job is found
+    once and the node unlinked where it was found.
+Input(s):
+    key - job key reference. job to remove.
+Return(s):
+    true - the job was removed.
+    false - the job was not in the tree.
+*/
+inline bool job_tree::erase(const job_key& key) {
+    node *leaf = search(key);
+    if (leaf == NULL) return false;
+    index_erase(leaf);
+    erase_node(leaf);
+    return true;
+}
+
+/*
+Function Name: erase_range
+Description:
+    Removes every job from lo through hi (inclusive). The
+    tree part is O(log n) (see btree::erase_range); with
+    secondary indexes enabled each removed job is also taken
+    out of them, O(log n) per job.
+Input(s):
+    lo - job key reference. first job to remove.
+    hi - job key reference. last job to remove.
+Return(s):
+    removed - size_t. jobs removed.
+*/
+inline size_t job_tree::erase_range(const job_key& lo, const job_key& hi) {
+    if (has_indexes()) {
+        iterator last = upper_bound(hi);
+        for (iterator it = lower_bound(lo); it != last; ++it) index_erase(it.get());
+    }
+    return btree::erase_range(lo, hi);
+}
+
+/*
+Function Name: index
+Description:
+    Gets a secondary index for walking it directly. Each
+    entry's value is the job's node in this tree.
+Input(s):
+    field - job_index_field. which index.
+Return(s):
+    index - job index pointer.
+    NULL - the index is not enabled.
+*/
+inline const job_index *job_tree::index(job_index_field field) const {
+    return indexes[field].get();
+}
+
+/*
+Function Name: index_range
+Description:
+    Threshold query: collects every job whose profit or
+    cost is from lo through hi (inclusive), in ascending
+    order of that field, in O(log n + k). Pass infinity as
+    hi for "over lo" and -infinity as lo for "under hi".
+Input(s):
+    field - job_index_field. which index.
+    lo - float. smallest value to include.
+    hi - float. largest value to include.
+    jobs - vector of node pointers. receives the jobs.
+Return(s):
+    found - size_t. jobs added, 0 if the index is not enabled.
+*/
+inline size_t job_tree::index_range(job_index_field field, float lo, float hi, std::vector<node *>& jobs) const {
+    const job_index *idx = indexes[field].get();
+    if (idx == NULL) return 0;
+
+    size_t found = 0;
+    job_index_key first = {lo, job_key()};
+    for (job_index::iterator it = idx->lower_bound(first); it != idx->end(); ++it) {
+        if (hi < it->key.metric) break;
+        jobs.push_back(it->value);
+        found++;
+    }
+    return found;
+}
+
+/*
+Function Name: index_top
+Description:
+    Top-K query: collects the k jobs with the largest (or
+    smallest) profit or cost, best first, in O(log n + k).
+    e.g. the 100 biggest losses are index_top(
+    JOB_INDEX_PROFIT, 100, false, jobs).
+Input(s):
+    field - job_index_field. which index.
+    k - size_t. most jobs to collect.
+    largest - bool. true for the largest values first,
+              false for the smallest first.
+    jobs - vector of node pointers. receives the jobs.
+Return(s):
+    found - size_t. jobs added, 0 if the index is not enabled.
+*/
+inline size_t job_tree::index_top(job_index_field field, size_t k, bool largest, std::vector<node *>& jobs) const {
+    const job_index *idx = indexes[field].get();
+    if (idx == NULL) return 0;
+
+    size_t found = 0;
+    if (largest) {
+        for (job_index::reverse_iterator it = idx->rbegin(); (it != idx->rend()) && (found < k); ++it, found++) jobs.push_back(it->value);
+    } else {
+        for (job_index::iterator it = idx->begin(); (it != idx->end()) && (found < k); ++it, found++) jobs.push_back(it->value);
+    }
+    return found;
+}
+
+/*
+Function Name: insert_unique
+Description:
+    Inserts a job unless it is already there, adding it to
+    the secondary indexes, without printing anything.
+Input(s):
+    key - job key reference. job to insert.
+    data - job data reference. cost and estimate.
+Return(s):
+    (leaf, true) - the new job.
+    (leaf, false) - the job already in the tree.
+*/
+inline std::pair<job_tree::node *, bool> job_tree::insert_unique(const job_key& key, const job_data& data) {
+    std::pair<node *, bool> result = btree::insert_unique(key, data);
+    if (result.second) index_insert(result.first);
+    return result;
+}
+
+/*
+Function Name: intersect
+Description:
+    Keeps only the jobs whose key is also in another tree
+    (see btree::intersect). Kept jobs keep this tree's cost
+    and estimate. other is left empty. With secondary
+    indexes enabled here, the dropped jobs leave them.
+Input(s):
+    other - job tree reference. jobs to keep. left empty.
+    pool - thread_pool pointer. NULL to run on this thread.
+Return(s):
+    None
+*/
+inline void job_tree::intersect(job_tree& other, thread_pool *pool) {
+    if (&other == this) return;
+
+    if (has_indexes()) {
+        for (iterator it = begin(); it != end(); ++it) {
+            if (!other.search(it->key)) index_erase(it.get());
+        }
+    }
+    for (int field = 0; field < JOB_INDEX_FIELDS; field++) {
+        if (other.indexes[field]) other.indexes[field]->destroy_tree();
+    }
+    btree::intersect(other, pool);
+}
+
+/*
+Function Name: join
+Description:
+    Moves every job of another tree onto the end of this
+    one in O(log n). Every job in right must come after the
+    newest job here. right is left empty. With secondary
+    indexes enabled here, the moved jobs are added to them.
+Input(s):
+    right - job tree reference. tree of newer jobs.
+Return(s):
+    true - the trees were joined.
+    false - the job ranges overlap, nothing was moved.
+*/
+inline bool job_tree::join(job_tree& right) {
+    if ((&right == this) || right.empty()) return &right != this;
+    if (!empty() && !job_key_less()(max_node()->key, right.min_node()->key)) return false;
+
+    std::vector<node *> moved;
+    if (has_indexes()) {
+        for (iterator it = right.begin(); it != right.end(); ++it) moved.push_back(it.get());
+    }
+    for (int field = 0; field < JOB_INDEX_FIELDS; field++) {
+        if (right.indexes[field]) right.indexes[field]->destroy_tree();
+    }
+
+    btree::join(right);
+    for (size_t i = 0; i < moved.size(); i++) index_insert(moved[i]);
+    return true;
+}
+
+/*
+Function Name: merge
+Description:
+    Moves every job of another tree into this one (see
+    btree::merge). A job in both trees keeps this tree's
+    cost and estimate. other is left empty. With secondary
+    indexes enabled here, the added jobs join them.
+Input(s):
+    other - job tree reference. jobs to add. left empty.
+    pool - thread_pool pointer. NULL to run on this thread.
+Return(s):
+    None
+*/
+inline void job_tree::merge(job_tree& other, thread_pool *pool) {
+    if (&other == this) return;
+
+    std::vector<node *> added;
+    if (has_indexes()) {
+        for (iterator it = other.begin(); it != other.end(); ++it) {
+            if (!search(it->key)) added.push_back(it.get());
+        }
+    }
+    for (int field = 0; field < JOB_INDEX_FIELDS; field++) {
+        if (other.indexes[field]) other.indexes[field]->destroy_tree();
+    }
+
+    btree::merge(other, pool);
+    for (size_t i = 0; i < added.size(); i++) index_insert(added[i]);
+}
+
+/*
+Function Name: new_job
+Description:
+    Public BTREE function to insert new job
+    into binary tree.
+Input(s):
+    year - unsigned integer. job year.
+    job_number - unsigned integer. job number.
+    job_cost - float. actual cost of job.
+    job_estimate - float. estimated cost of job.
+Return(s):
+    None
+*/
+inline void job_tree::new_job(unsigned int year, unsigned int job_number, float job_cost, float job_estimate) {
+    job_key key = {year, job_number};
+    job_data data = {job_cost, job_estimate};
+    if (!insert_unique(key, data).second) {
+        std::cout << "\033[33m[!] JOB " << year << "-" << job_number << " Already Exists.\033[0m" << std::endl;
+    }
+}
+
+/*
+Function Name: print_ascending
+Description:
+    Public function designed to display the jobs from
+    oldest to newest.
+
+    The whole report is rendered by one job_report, so the
+    locale is set up once instead of once per job.
+Input(s):
+    layout - job_report_layout. text, CSV or TSV.
+    out - output stream reference. defaults to std::cout.
+Return(s):
+    None
+*/
+inline void job_tree::print_ascending(job_report_layout layout, std::ostream& out) {
+    if (root == NULL) {
+        std::cout << "\033[31m[!] No Jobs To Display\033[0m" << std::endl;
+        return;
+    }
+    job_report report(layout);
+    report.write(begin(), end(), out);
+}
+
+/*
+Function Name: print_descending
+Description:
+    Public function designed to display the jobs from
+    newest to oldest.
+Input(s):
+    layout - job_report_layout. text, CSV or TSV.
+    out - output stream reference. defaults to std::cout.
+Return(s):
+    None
+*/
+inline void job_tree::print_descending(job_report_layout layout, std::ostream& out) {
+    if (root == NULL) {
+        std::cout << "\033[31m[!] No Jobs To Display\033[0m" << std::endl;
+        return;
+    }
+    job_report report(layout);
+    report.write(rbegin(), rend(), out);
+}
+
+/*
+Function Name: profit_histogram
+Description:
+    Counts jobs by profit (estimate - cost) into bins of
+    equal width, with parallel_reduce() across an optional
+    thread pool. Profits below lo land in the first bin and
+    profits past the last bin in the last one.
+Input(s):
+    lo - float. lower edge of the first bin.
+    width - float. width of every bin.
+    bins - size_t. number of bins.
+    pool - thread_pool pointer. NULL to run on this thread.
+Return(s):
+    counts - vector of size_t. jobs per bin.
+*/
+inline std::vector<size_t> job_tree::profit_histogram(float lo, float width, size_t bins, thread_pool *pool) const {
+    if (bins == 0) return std::vector<size_t>();
+
+    return parallel_reduce(std::vector<size_t>(bins, 0), [lo, width, bins](std::vector<size_t>& counts, const node& leaf) {
+        float slot = (leaf.value.job_estimate - leaf.value.job_cost - lo) / width;
+        size_t bin = 0;
+        if (slot >= (float)bins) bin = bins - 1;
+        else if (slot > 0) bin = (size_t)slot;
+        counts[bin]++;
+    }, [](std::vector<size_t>& into, const std::vector<size_t>& part) {
+        for (size_t i = 0; i < into.size(); i++) into[i] += part[i];
+    }, pool);
+}
+
+/*
+Function Name: purge_before
+Description:
+    Retention purge: removes every job older than
+    first_year with one erase_range(), so the whole span is
+    cut off in O(log n) instead of one delete per job.
+Input(s):
+    first_year - unsigned int. oldest year to keep.
+Return(s):
+    removed - size_t. jobs removed.
+*/
+inline size_t job_tree::purge_before(unsigned int first_year) {
+    if (first_year == 0) return 0;
+    job_key lo = {0, 0};
+    job_key hi = {first_year - 1, UINT_MAX};
+    return erase_range(lo, hi);
+}
+
+/*
+Function Name: rebuild_indexes
+Description:
+    Rebuilds every enabled secondary index from the tree.
+    Needed only after the tree is filled through the base
+    btree directly (e.g. a bulk btree::build_from).
+Input(s):
+    None
+Return(s):
+    None
+*/
+inline void job_tree::rebuild_indexes() {
+    for (int field = 0; field < JOB_INDEX_FIELDS; field++) {
+        if (indexes[field]) enable_index((job_index_field)field);
+    }
+}
+
+/*
+Function Name: search_job
+Description:
+    Searches the tree for a job and returns the node if it exists.
+    If the job does not exist, it returns NULL.
+Input(s):
+    year - unsigned integer. job year.
+    jno - unsigned integer. job number.
+Return(s):
+    leaf - node pointer. job node.
+    NULL - job does not exist in tree.
+*/
+inline job_tree::node* job_tree::search_job(unsigned int year, unsigned int jno) {
+    if (root != NULL) {
+        job_key key = {year, jno};
+        return search(key);
+    } else {
+        std::cout << "\033[31m[!] No Jobs To Search\033[0m" << std::endl;
+        return NULL;
+    }
+}
+
+/*
+Function Name: search_newest
+Description:
+    Public BTREE function to find the newest job
+    in the binary tree.
+Input(s):
+    None.
+Return(s):
+    leaf - node pointer. newest (year & job num) job node.
+*/
+inline job_tree::node* job_tree::search_newest() {
+    if (root != NULL) return max_node();
+    else {
+        std::cout << "\033[31m[!] No Jobs To Search\033[0m" << std::endl;
+        return NULL;
+    }
+}
+
+/*
+Function Name: search_oldest
+Description:
+    Public BTREE function to find the oldest job
+    in the binary tree.
+Input(s):
+    None.
+Return(s):
+    leaf - node pointer. oldest (year & job num) job node.
+*/
+inline job_tree::node* job_tree::search_oldest() {
+    if (root != NULL) return min_node();
+    else {
+        std::cout << "[!] No Jobs To Search" << std::endl;
+        return NULL;
+    }
+}
+
+/*
+Function Name: split
+Description:
+    Moves every job at or after key into another job tree
+    in O(log n), leaving the older jobs here. Whatever right
+    held before is deleted first. Secondary indexes follow
+    the jobs: moved jobs leave this tree's indexes and join
+    right's, O(log n) per moved job.
+Input(s):
+    key - job key reference. first job to move.
+    right - job tree reference. receives the newer jobs.
+Return(s):
+    None
+*/
+inline void job_tree::split(const job_key& key, job_tree& right) {
+    if (&right == this) return;
+
+    right.destroy_tree();
+    std::vector<node *> moved;
+    if (has_indexes() || right.has_indexes()) {
+        for (iterator it = lower_bound(key); it != end(); ++it) {
+            index_erase(it.get());
+            moved.push_back(it.get());
+        }
+    }
+
+    btree::split(key, right);
+    for (size_t i = 0; i < moved.size(); i++) right.index_insert(moved[i]);
+}
+
+/*
+Function Name: update_job
+Description:
+    Public BTREE function to change the cost and estimate
+    of an existing job in place. The subtree summaries on
+    the path to the root and the secondary indexes are
+    brought up to date.
+Input(s):
+    year - unsigned int. job year.
+    jno - unsigned int. job number.
+    job_cost - float. new actual cost of job.
+    job_estimate - float. new estimated cost of job.
+Return(s):
+    None
+*/
+inline void job_tree::update_job(unsigned int year, unsigned int jno, float job_cost, float job_estimate) {
+    job_key key = {year, jno};
+    node *leaf = search(key);
+    if (leaf == NULL) {
+        std::cout << "\033[31mJob: " << year << "-";
+        std::cout << std::setfill('0') << std::setw(3) << jno;
+        std::cout << " Not Found.\033[0m" << std::endl;
+        return;
+    }
+
+    index_erase(leaf);
+    leaf->value.job_cost = job_cost;
+    leaf->value.job_estimate = job_estimate;
+    update_path(leaf);
+    index_insert(leaf);
+}
+
+/*
+Function Name: year_range
+Description:
+    Gets every job from first_year through last_year as an
+    iterator range, in ascending order.
+Input(s):
+    first_year - unsigned integer. first year to include.
+    last_year - unsigned integer. last year to include.
+Return(s):
+    (first, last) - iterators bounding the jobs.
+*/
+inline std::pair<job_tree::iterator, job_tree::iterator> job_tree::year_range(unsigned int first_year, unsigned int last_year) {
+    job_key lo = {first_year, 0};
+    job_key hi = {last_year, UINT_MAX};
+    return std::make_pair(lower_bound(lo), upper_bound(hi));
+}
+
+/*
+Function Name: year_summary
+Description:
+    Totals every job from first_year through last_year:
+    count, cost, estimate and the lowest and highest
+    profit, in O(log n) from the subtree summaries.
+Input(s):
+    first_year - unsigned integer. first year to include.
+    last_year - unsigned integer. last year to include.
+Return(s):
+    summary - job_summary. count 0 if there are no jobs.
+*/
+inline job_summary job_tree::year_summary(unsigned int first_year, unsigned int last_year) const {
+    job_key lo = {first_year, 0};
+    job_key hi = {last_year, UINT_MAX};
+    return aggregate(lo, hi);
+}
+
+// --------- END Class Functions --------------
+
+#endif
@@ -0,0 +1,669 @@
+/*
+Created By: Thomas Osgood
+
+Description:
+    Write-ahead log for the job tree, so new_job/delete_job
+    survive a crash.
+
+    job_wal is an append-only file of committed batches:
+        file header  - "JOBWAL1" magic, 16 bytes.
+        batch header - payload bytes, record count and the
+                       checksum of the payload, 16 bytes.
+        records      - 'I' + packed key + cost + estimate
+                       (17 bytes) or 'D' + packed key (9).
+
+    Group commit: appends only fill a memory buffer. The
+    first thread to call commit() becomes the leader: it
+    takes everything buffered so far, writes it as one batch
+    and calls fdatasync() once, while threads that commit in
+    the meantime wait for it (or the next leader) instead of
+    syncing on their own. One fsync covers many mutations.
+
+    logged_job_tree puts the log in front of a job_tree:
+        open()       - load the last snapshot (job_snapshot.h)
+                       and replay the log on top of it.
+        new_job() /
+        delete_job() - apply to the tree, append to the log
+                       and return once the record is on
+                       disk. Threads mutating at the same
+                       time share one group commit.
+        checkpoint() - compaction: save a fresh snapshot and
+                       empty the log. Runs on its own once the
+                       log passes compact_bytes.
+
+    A crash between saving the snapshot and emptying the
+    log only means the old log is replayed onto the new
+    snapshot. Inserts never overwrite and deletes of missing
+    jobs do nothing, so that replay ends in the same state.
+
+    To Use:
+    logged_job_tree jobs;
+    jobs.open("jobs.snap", "jobs.wal");
+    jobs.new_job(21, 7, 18000, 22000);
+    jobs.commit();
+*/
+#ifndef JOB_WAL_H
+#define JOB_WAL_H
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "job_snapshot.h"
+#include "job_tree.h"
+
+/*
+    Define Write-Ahead Log Class
+*/
+class job_wal {
+
+public:
+    job_wal();
+    ~job_wal();
+
+    uint64_t bytes() const;
+    void close();
+    bool commit();
+    bool commit(uint64_t lsn);
+    bool healthy() const;
+    uint64_t log_delete(const job_key& key);
+    uint64_t log_insert(const job_key& key, const job_data& data);
+    bool open(const char *path);
+    size_t replay(job_tree& jobs);
+    bool reset();
+
+private:
+    static const size_t batch_header = 16;
+    static const size_t file_header = 16;
+
+    uint64_t append(const char *record, size_t n);
+    void start_batch();
+
+    uint64_t durable_lsn; // last record known to be on disk
+    bool failed; // a write or sync failed, the log is unusable
+    int fd;
+    uint64_t file_bytes;
+    std::condition_variable flushed;
+    bool flushing; // a leader is writing a batch
+    mutable std::mutex lock;
+    uint64_t next_lsn; // last record appended
+    std::vector<char> pending; // batch being filled
+    uint32_t pending_records;
+
+    job_wal(const job_wal&);
+    job_wal& operator=(const job_wal&);
+};
+
+/*
+    Define Logged Job Tree Class
+*/
+class logged_job_tree {
+
+public:
+    logged_job_tree(uint64_t compact_bytes = 64 << 20);
+
+    bool checkpoint();
+    bool commit();
+    bool delete_job(unsigned int year, unsigned int jno);
+    const job_tree& jobs() const;
+    bool new_job(unsigned int year, unsigned int job_number, float job_cost = 0.0, float job_estimate = 0.0);
+    bool open(const char *snapshot_path, const char *wal_path);
+
+private:
+    bool checkpoint_locked();
+    bool logged(uint64_t lsn);
+
+    uint64_t compact_bytes; // log size that triggers a checkpoint
+    std::mutex lock; // guards tree and the order of log appends
+    std::string snapshot_path;
+    job_tree tree;
+    job_wal wal;
+};
+
+// --------- BEGIN Class Functions --------------
+
+/*
+Function Name: job_wal
+Description:
+    Creates a log with no file open.
+Input(s):
+    None
+Return(s):
+    None
+*/
+inline job_wal::job_wal() : durable_lsn(0), failed(false), fd(-1), file_bytes(0), flushing(false), next_lsn(0), pending_records(0) {
+    start_batch();
+}
+
+/*
+Function Name: ~job_wal
+Description:
+    Commits anything still buffered and closes the file.
+Input(s):
+    None
+Return(s):
+    None
+*/
+inline job_wal::~job_wal() {
+    close();
+}
+
+// --------- PRIVATE Class Functions --------------
+
+/*
+Function Name: append
+Description:
+    Adds one encoded record to the batch being filled.
+Input(s):
+    record - char pointer. encoded record.
+    n - size_t. record length in bytes.
+Return(s):
+    lsn - uint64_t. sequence number of the record, for commit(lsn).
+*/
+inline uint64_t job_wal::append(const char *record, size_t n) {
+    std::lock_guard<std::mutex> guard(lock);
+    pending.insert(pending.end(), record, record + n);
+    pending_records++;
+    return ++next_lsn;
+}
+
+/*
+Function Name: start_batch
+Description:
+    Empties the pending batch, leaving room for its header.
+Input(s):
+    None
+Return(s):
+    None
+*/
+inline void job_wal::start_batch() {
+    pending.assign(batch_header, 0);
+    pending_records = 0;
+}
+
+// --------- PUBLIC Class Functions --------------
+
+/*
+Function Name: bytes
+Description:
+    Gets the size of the log, committed and pending.
+Input(s):
+    None
+Return(s):
+    bytes - uint64_t. log size in bytes.
+*/
+inline uint64_t job_wal::bytes() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return file_bytes + pending.size() - batch_header;
+}
+
+/*
+Function Name: close
+Description:
+    Commits anything still buffered and closes the file.
+Input(s):
+    None
+Return(s):
+    None
+*/
+inline void job_wal::close() {
+    if (fd < 0) return;
+    commit();
+    ::close(fd);
+    fd = -1;
+}
+
+/*
+Function Name: commit
+Description:
+    Makes every record appended so far durable.
+Input(s):
+    None
+Return(s):
+    true - the records are on disk.
+    false - the log is not open or a write failed.
+*/
+inline bool job_wal::commit() {
+    uint64_t lsn;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        lsn = next_lsn;
+    }
+    return commit(lsn);
+}
+
+/*
+Function Name: commit
+Description:
+    Waits until the record lsn is durable. If no batch is
+    being written, this thread writes everything buffered
+    as one batch and syncs it; otherwise it waits for the
+    thread that is, and checks again.
+Input(s):
+    lsn - uint64_t. sequence number from log_insert/log_delete.
+Return(s):
+    true - the record is on disk.
+    false - the log is not open, a write failed or no
+            record lsn was ever appended.
+*/
+inline bool job_wal::commit(uint64_t lsn) {
+    std::unique_lock<std::mutex> guard(lock);
+    if (lsn > next_lsn) return false; // would never become durable
+    while ((durable_lsn < lsn) && !failed && (fd >= 0)) {
+        if (flushing) {
+            flushed.wait(guard);
+            continue;
+        }
+
+        // ------ Lead: Take The Whole Batch ------
+        flushing = true;
+        std::vector<char> batch;
+        batch.swap(pending);
+        uint32_t records = pending_records;
+        uint64_t last = next_lsn;
+        start_batch();
+        guard.unlock();
+
+        uint32_t payload = batch.size() - batch_header;
+        uint64_t sum = job_snapshot::checksum(&batch[batch_header], payload);
+        std::memcpy(&batch[0], &payload, 4);
+        std::memcpy(&batch[4], &records, 4);
+        std::memcpy(&batch[8], &sum, 8);
+        bool ok = job_snapshot::write_all(fd, &batch[0], batch.size()) && (fdatasync(fd) == 0);
+
+        guard.lock();
+        flushing = false;
+        if (ok) {
+            durable_lsn = last;
+            file_bytes += batch.size();
+        } else failed = true;
+        flushed.notify_all();
+    }
+    return durable_lsn >= lsn;
+}
+
+/*
+Function Name: healthy
+Description:
+    Tells whether the log is open and nothing has failed
+    (a write, sync, truncate or the read during replay).
+Input(s):
+    None
+Return(s):
+    true - the log can take new records.
+    false - the log is not open or a failure was seen.
+*/
+inline bool job_wal::healthy() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return (fd >= 0) && !failed;
+}
+
+/*
+Function Name: log_delete
+Description:
+    Appends a delete record. Not durable until committed.
+Input(s):
+    key - job key reference. job that was deleted.
+Return(s):
+    lsn - uint64_t. sequence number of the record.
+*/
+inline uint64_t job_wal::log_delete(const job_key& key) {
+    char record[9];
+    record[0] = 'D';
+    std::memcpy(record + 1, &key.packed, 8);
+    return append(record, sizeof(record));
+}
+
+/*
+Function Name: log_insert
+Description:
+    Appends an insert record. Not durable until committed.
+Input(s):
+    key - job key reference. job that was inserted.
+    data - job data reference. cost and estimate.
+Return(s):
+    lsn - uint64_t. sequence number of the record.
+*/
+inline uint64_t job_wal::log_insert(const job_key& key, const job_data& data) {
+    char record[17];
+    record[0] = 'I';
+    std::memcpy(record + 1, &key.packed, 8);
+    std::memcpy(record + 9, &data.job_cost, 4);
+    std::memcpy(record + 13, &data.job_estimate, 4);
+    return append(record, sizeof(record));
+}
+
+/*
+Function Name: open
+Description:
+    Opens (or creates) a log file for appending. A new log
+    has its directory synced too, so it is not lost with
+    the first commits. Call replay() before logging
+    anything new to an old log.
+Input(s):
+    path - char pointer. log file.
+Return(s):
+    true - the log is open.
+    false - the file could not be opened or is not a log.
+*/
+inline bool job_wal::open(const char *path) {
+    close();
+    fd = ::open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) return false;
+
+    struct stat info;
+    char magic[file_header] = "JOBWAL1";
+    bool ok = (fstat(fd, &info) == 0);
+    if (ok && (info.st_size == 0)) {
+        ok = job_snapshot::write_all(fd, magic, file_header) && (fsync(fd) == 0) && job_snapshot::sync_directory(path);
+        info.st_size = file_header;
+    } else if (ok) {
+        char found[file_header];
+        ok = (pread(fd, found, file_header, 0) == (ssize_t)file_header) && (std::memcmp(found, magic, 8) == 0);
+    }
+    if (!ok) {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    file_bytes = info.st_size;
+    failed = false;
+    start_batch();
+    return true;
+}
+
+/*
+Function Name: replay
+Description:
+    Applies every committed batch in the log to a tree, in
+    order. A torn or corrupt batch at the end (a crash in
+    the middle of a commit) stops the replay and is cut off
+    the file, so new batches follow the last good one. If
+    the log can not be read the log is marked failed
+    (see healthy()) and nothing is cut off.
+Input(s):
+    jobs - job tree reference. tree to apply the log to.
+Return(s):
+    records - size_t. number of records replayed.
+*/
+inline size_t job_wal::replay(job_tree& jobs) {
+    if (fd < 0) return 0;
+
+    struct stat info;
+    std::vector<char> log;
+    bool ok = (fstat(fd, &info) == 0);
+    if (ok) log.resize(info.st_size);
+    size_t have = 0;
+    while (ok && (have < log.size())) {
+        ssize_t n = pread(fd, &log[have], log.size() - have, have);
+        if ((n < 0) && (errno == EINTR)) continue;
+        ok = (n > 0);
+        if (ok) have += n;
+    }
+    if (!ok) {
+        std::lock_guard<std::mutex> guard(lock);
+        failed = true;
+        return 0;
+    }
+
+    size_t pos = file_header;
+    size_t records = 0;
+    while (pos + batch_header <= have) {
+        uint32_t payload;
+        uint32_t count;
+        uint64_t sum;
+        std::memcpy(&payload, &log[pos], 4);
+        std::memcpy(&count, &log[pos + 4], 4);
+        std::memcpy(&sum, &log[pos + 8], 8);
+        if ((payload > have - pos - batch_header) || (job_snapshot::checksum(&log[pos + batch_header], payload) != sum)) break;
+
+        const char *rec = &log[pos + batch_header];
+        const char *end = rec + payload;
+        for (uint32_t i = 0; (i < count) && (rec < end); i++) {
+            job_key key;
+            if ((rec[0] == 'I') && (end - rec >= 17)) {
+                job_data data;
+                std::memcpy(&key.packed, rec + 1, 8);
+                std::memcpy(&data.job_cost, rec + 9, 4);
+                std::memcpy(&data.job_estimate, rec + 13, 4);
+                jobs.insert_unique(key, data);
+                rec += 17;
+            } else if ((rec[0] == 'D') && (end - rec >= 9)) {
+                std::memcpy(&key.packed, rec + 1, 8);
+                jobs.erase(key);
+                rec += 9;
+            } else break;
+            records++;
+        }
+        pos += batch_header + payload;
+    }
+
+    bool cut = (pos == (size_t)info.st_size) || ((ftruncate(fd, pos) == 0) && (fsync(fd) == 0));
+    std::lock_guard<std::mutex> guard(lock);
+    if (!cut) failed = true;
+    file_bytes = pos;
+    return records;
+}
+
+/*
+Function Name: reset
+Description:
+    Empties the log (keeping the file header), once its
+    records are safely in a snapshot. Records appended but
+    not committed are dropped as well.
+Input(s):
+    None
+Return(s):
+    true - the log is empty on disk.
+    false - the log is not open or the truncate failed.
+*/
+inline bool job_wal::reset() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (flushing) flushed.wait(guard);
+    if (fd < 0) return false;
+
+    start_batch();
+    durable_lsn = next_lsn;
+    bool ok = (ftruncate(fd, file_header) == 0) && (fsync(fd) == 0);
+    if (ok) file_bytes = file_header;
+    else failed = true;
+    return ok;
+}
+
+/*
+Function Name: logged_job_tree
+Description:
+    Creates an empty logged tree. Call open() before use.
+Input(s):
+    compact_bytes - uint64_t. log size that triggers a
+                    checkpoint.
+Return(s):
+    None
+*/
+inline logged_job_tree::logged_job_tree(uint64_t compact_bytes) : compact_bytes(compact_bytes) {
+}
+
+/*
+Function Name: checkpoint_locked
+Description:
+    checkpoint() body, for callers that hold the lock.
+    The log is only emptied once save() reports the
+    snapshot and its directory entry are on disk.
+Input(s):
+    None
+Return(s):
+    true - the snapshot was saved and the log emptied.
+    false - the snapshot or the log could not be written.
+*/
+inline bool logged_job_tree::checkpoint_locked() {
+    if (!wal.commit()) return false;
+    if (!job_snapshot::save(tree, snapshot_path.c_str())) return false;
+    return wal.reset();
+}
+
+/*
+Function Name: logged
+Description:
+    Commit policy after a mutation: waits until the record
+    is durable, so a mutation is only reported once it
+    would survive a crash. Threads waiting at the same time
+    are covered by one leader's write and sync (see
+    job_wal::commit). A log that has grown past
+    compact_bytes is compacted.
+Input(s):
+    lsn - uint64_t. sequence number of the new record.
+Return(s):
+    true - the record is on disk.
+    false - a commit or checkpoint failed.
+*/
+inline bool logged_job_tree::logged(uint64_t lsn) {
+    if (!wal.commit(lsn)) return false;
+    if (wal.bytes() < compact_bytes) return true;
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (wal.bytes() < compact_bytes) return true;
+    return checkpoint_locked();
+}
+
+/*
+Function Name: checkpoint
+Description:
+    Compacts the log: saves a snapshot of the tree and
+    empties the log. Mutations wait while it runs.
+Input(s):
+    None
+Return(s):
+    true - the snapshot was saved and the log emptied.
+    false - the snapshot or the log could not be written.
+*/
+inline bool logged_job_tree::checkpoint() {
+    std::lock_guard<std::mutex> guard(lock);
+    return checkpoint_locked();
+}
+
+/*
+Function Name: commit
+Description:
+    Makes every mutation so far durable. new_job() and
+    delete_job() already wait for their own record.
+Input(s):
+    None
+Return(s):
+    true - the mutations are on disk.
+    false - the log failed.
+*/
+inline bool logged_job_tree::commit() {
+    return wal.commit();
+}
+
+/*
+Function Name: delete_job
+Description:
+    Deletes a job and logs the delete.
+Input(s):
+    year - unsigned int. job year.
+    jno - unsigned int. job number.
+Return(s):
+    true - the job was deleted and the delete is on disk.
+    false - the job did not exist, or the log failed.
+*/
+inline bool logged_job_tree::delete_job(unsigned int year, unsigned int jno) {
+    job_key key(year, jno);
+    uint64_t lsn;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!tree.erase(key)) return false;
+        lsn = wal.log_delete(key);
+    }
+    return logged(lsn);
+}
+
+/*
+Function Name: jobs
+Description:
+    Gets the tree for searches and reports. Do not read it
+    while other threads are changing it.
+Input(s):
+    None
+Return(s):
+    tree - job tree reference.
+*/
+inline const job_tree& logged_job_tree::jobs() const {
+    return tree;
+}
+
+/*
+Function Name: new_job
+Description:
+    Inserts a job and logs the insert.
+Input(s):
+    year - unsigned integer. job year.
+    job_number - unsigned integer. job number.
+    job_cost - float. actual cost of job.
+    job_estimate - float. estimated cost of job.
+Return(s):
+    true - the job was inserted and the insert is on disk.
+    false - the job already exists, or the log failed.
+*/
+inline bool logged_job_tree::new_job(unsigned int year, unsigned int job_number, float job_cost, float job_estimate) {
+    job_key key(year, job_number);
+    job_data data = {job_cost, job_estimate};
+    uint64_t lsn;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!tree.insert_unique(key, data).second) return false;
+        lsn = wal.log_insert(key, data);
+    }
+    return logged(lsn);
+}
+
+/*
+Function Name: open
+Description:
+    Recovers the tree: loads the snapshot if there is one,
+    then replays the log on top of it and opens the log
+    for new mutations.
+Input(s):
+    snapshot_path - char pointer. snapshot file.
+    wal_path - char pointer. log file.
+Return(s):
+    true - the tree is recovered and ready.
+    false - the snapshot is corrupt, or the log could not
+            be opened or replayed.
+*/
+inline bool logged_job_tree::open(const char *snapshot_path, const char *wal_path) {
+    std::lock_guard<std::mutex> guard(lock);
+    this->snapshot_path = snapshot_path;
+    tree.destroy_tree();
+
+    if (access(snapshot_path, F_OK) == 0) {
+        job_snapshot snapshot;
+        if (!snapshot.open_mapped(snapshot_path)) return false;
+
+        std::vector<job_record> records;
+        records.reserve(snapshot.size());
+        for (job_snapshot::iterator it = snapshot.begin(); it != snapshot.end(); ++it) {
+            job_record record = {it->key.year(), it->key.job_number(), it->value.job_cost, it->value.job_estimate};
+            records.push_back(record);
+        }
+        tree.build_from(records.begin(), records.end());
+    }
+
+    if (!wal.open(wal_path)) return false;
+    wal.replay(tree);
+    return wal.healthy();
+}
+
+// --------- END Class Functions --------------
+
+#endif
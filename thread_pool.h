@@ -0,0 +1,248 @@
+/*
+Created By: Thomas Osgood
+
+Description:
+    Fixed size thread pool for fanning work out over the
+    shards of a job_shards store (and anything else that
+    splits into independent pieces).
+
+    run(n, f) calls f(0) .. f(n - 1) on the pool and returns
+    once every call is done. The calling thread works through
+    the queue too while it waits, so a pool of N threads has
+    N - 1 workers, a one thread pool runs everything inline,
+    and run() can be called from inside a task without
+    deadlocking. The first exception a task throws is
+    rethrown from run() after the rest have finished.
+
+    parallel_run(pool, n, f) does the same but runs inline
+    when no pool is given, for code that takes an optional
+    pool.
+
+    To Use:
+    thread_pool pool;
+    pool.run(shards, [&](size_t i) { totals[i] = work(i); });
+*/
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+    Define Thread Pool Class
+*/
+class thread_pool {
+
+public:
+    thread_pool(unsigned int threads = 0);
+    ~thread_pool();
+    template <class F>
+    void run(size_t tasks, const F& f);
+    unsigned int size() const;
+
+private:
+    /*
+        Create Structure For One run() Call
+    */
+    struct batch {
+        size_t left; // tasks not finished yet
+        std::exception_ptr error; // first exception thrown
+    };
+
+    thread_pool(const thread_pool&);
+    thread_pool& operator=(const thread_pool&);
+
+    void finish(batch& owner, std::exception_ptr error);
+    bool run_one(std::unique_lock<std::mutex>& hold);
+    void work();
+
+    std::condition_variable done; // a batch finished
+    std::mutex lock; // guards queue, stopping and every batch
+    std::deque<std::function<void()> > queue;
+    std::condition_variable ready; // queue not empty or stopping
+    bool stopping;
+    std::vector<std::thread> workers;
+};
+
+// --------- BEGIN Class Functions --------------
+
+/*
+Function Name: thread_pool
+Description:
+    Starts the worker threads.
+Input(s):
+    threads - unsigned int. threads to run tasks on, the
+              caller of run() included. 0 for one per core.
+Return(s):
+    None
+*/
+inline thread_pool::thread_pool(unsigned int threads) : stopping(false) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int i = 1; i < threads; i++) workers.push_back(std::thread(&thread_pool::work, this));
+}
+
+/*
+Function Name: ~thread_pool
+Description:
+    Stops and joins the worker threads. run() must not be
+    in progress.
+Input(s):
+    None
+Return(s):
+    None
+*/
+inline thread_pool::~thread_pool() {
+    {
+        std::lock_guard<std::mutex> hold(lock);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+}
+
+// --------- PRIVATE Class Functions --------------
+
+/*
+Function Name: finish
+Description:
+    Marks one task of a batch done, keeping the first
+    exception, and wakes run() when it was the last one.
+    Called with the lock held.
+Input(s):
+    owner - batch reference. batch the task belongs to.
+    error - exception pointer. what the task threw, if any.
+Return(s):
+    None
+*/
+inline void thread_pool::finish(batch& owner, std::exception_ptr error) {
+    if (error && !owner.error) owner.error = error;
+    if (--owner.left == 0) done.notify_all();
+}
+
+/*
+Function Name: run_one
+Description:
+    Takes one task off the queue and runs it with the lock
+    released. Called with the lock held.
+Input(s):
+    hold - lock reference. held on entry and on return.
+Return(s):
+    true - a task was run.
+    false - the queue was empty.
+*/
+inline bool thread_pool::run_one(std::unique_lock<std::mutex>& hold) {
+    if (queue.empty()) return false;
+    std::function<void()> task = std::move(queue.front());
+    queue.pop_front();
+    hold.unlock();
+    task();
+    hold.lock();
+    return true;
+}
+
+/*
+Function Name: work
+Description:
+    Worker thread loop: runs queued tasks until the pool is
+    stopped.
+Input(s):
+    None
+Return(s):
+    None
+*/
+inline void thread_pool::work() {
+    std::unique_lock<std::mutex> hold(lock);
+    while (true) {
+        ready.wait(hold, [this]() { return stopping || !queue.empty(); });
+        if (stopping) return;
+        run_one(hold);
+    }
+}
+
+// --------- PUBLIC Class Functions --------------
+
+/*
+Function Name: run
+Description:
+    Calls f(i) for every i in [0, tasks) across the pool and
+    waits for all of them. f must be safe to call from
+    several threads at once.
+Input(s):
+    tasks - size_t. number of calls.
+    f - callable reference. called as f(size_t).
+Return(s):
+    None
+*/
+template <class F>
+void thread_pool::run(size_t tasks, const F& f) {
+    if (tasks == 0) return;
+
+    batch owner;
+    owner.left = tasks;
+    std::unique_lock<std::mutex> hold(lock);
+    for (size_t i = 0; i < tasks; i++) {
+        queue.push_back([this, &owner, &f, i]() {
+            std::exception_ptr error;
+            try {
+                f(i);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> relock(lock);
+            finish(owner, error);
+        });
+    }
+    if (tasks > 1) ready.notify_all();
+
+    // help out until this batch is done
+    while (owner.left > 0) {
+        if (!run_one(hold)) done.wait(hold, [&owner, this]() { return (owner.left == 0) || !queue.empty(); });
+    }
+    if (owner.error) std::rethrow_exception(owner.error);
+}
+
+/*
+Function Name: size
+Description:
+    Gets the number of threads that run tasks, counting the
+    thread that calls run().
+Input(s):
+    None
+Return(s):
+    threads - unsigned int.
+*/
+inline unsigned int thread_pool::size() const {
+    return (unsigned int)workers.size() + 1;
+}
+
+// --------- END Class Functions --------------
+
+/*
+Function Name: parallel_run
+Description:
+    Calls f(i) for every i in [0, tasks), on a thread pool
+    when one is given, otherwise in order on this thread.
+Input(s):
+    pool - thread_pool pointer. NULL to run inline.
+    tasks - size_t. number of calls.
+    f - callable reference. called as f(size_t).
+Return(s):
+    None
+*/
+template <class F>
+void parallel_run(thread_pool *pool, size_t tasks, const F& f) {
+    if ((pool != NULL) && (tasks > 1)) {
+        pool->run(tasks, f);
+    } else {
+        for (size_t i = 0; i < tasks; i++) f(i);
+    }
+}
+
+#endif